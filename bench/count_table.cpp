@@ -0,0 +1,112 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include "src/count_table.h"
+
+// number of passes over the corpus per measurement, so that short runs are not dominated by thread start-up
+#define BENCH_NUM_PASSES 4
+
+/**** function prototypes ****/
+FreqDict count_with_table(const std::vector<std::string>&, size_t);
+FreqDict count_with_merge(const std::vector<std::string>&, size_t);
+
+/**** functions ****/
+
+/**
+ * counts the words of every email with a single table shared by all threads
+ */
+FreqDict count_with_table(const std::vector<std::string>& emails, size_t num_threads)
+{
+    ConcurrentCountTable table;
+    std::atomic<size_t> next_email{0};
+
+    auto count_emails = [&]()
+    {
+        for (size_t i = next_email++; i < BENCH_NUM_PASSES * emails.size(); i = next_email++)
+        {
+            const std::string& email = emails[i % emails.size()];
+            for (const auto& word : get_word_freq_in_buffer(email.data(), email.size()))
+                table.add(word.first, word.second);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i)
+        threads.emplace_back(count_emails);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return table.get_word_freq();
+}
+
+/**
+ * counts the words of every email in one dictionary per thread, and merges them afterwards
+ */
+FreqDict count_with_merge(const std::vector<std::string>& emails, size_t num_threads)
+{
+    std::vector<FreqDict> freq_by_thread(num_threads);
+    std::atomic<size_t> next_email{0};
+
+    auto count_emails = [&](FreqDict& word_freq)
+    {
+        for (size_t i = next_email++; i < BENCH_NUM_PASSES * emails.size(); i = next_email++)
+        {
+            const std::string& email = emails[i % emails.size()];
+            for (const auto& word : get_word_freq_in_buffer(email.data(), email.size()))
+                word_freq[word.first] += word.second;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i)
+        threads.emplace_back(count_emails, std::ref(freq_by_thread[i]));
+    for (std::thread& thread : threads)
+        thread.join();
+
+    FreqDict word_freq = std::move(freq_by_thread[0]);
+    for (size_t i = 1; i < num_threads; ++i)
+        for (const auto& word : freq_by_thread[i])
+            word_freq[word.first] += word.second;
+    return word_freq;
+}
+
+/**** main ****/
+// count_table_bench [email_dir]... : compares both ways of counting the words of the emails in
+// the given folders (../data/spam and ../data/ham by default) with 1 to 64 threads
+int main(int argc, char* argv[])
+{
+    std::vector<DirPath> dirs(argv + 1, argv + argc);
+    if (dirs.empty())
+        dirs = {"../data/spam/", "../data/ham/"};
+
+    std::vector<std::string> emails;
+    size_t num_bytes = 0;
+    for (const DirPath& dir : dirs)
+    {
+        for (const FilePath& file : get_files_in_folder(dir))
+        {
+            emails.emplace_back();
+            read_file(file, emails.back());
+            num_bytes += emails.back().size();
+        }
+    }
+    std::cout << emails.size() << " emails, " << num_bytes << " bytes, " << BENCH_NUM_PASSES << " passes, "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+    std::cout << "threads\ttable_ms\tmerge_ms\tsame_counts" << std::endl;
+
+    for (size_t num_threads = 1; num_threads <= 64; num_threads *= 2)
+    {
+        auto start = std::chrono::steady_clock::now();
+        FreqDict table_freq = count_with_table(emails, num_threads);
+        auto middle = std::chrono::steady_clock::now();
+        FreqDict merge_freq = count_with_merge(emails, num_threads);
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << num_threads << "\t"
+                  << std::chrono::duration<double, std::milli>(middle - start).count() << "\t"
+                  << std::chrono::duration<double, std::milli>(end - middle).count() << "\t"
+                  << (table_freq == merge_freq ? "yes" : "NO") << std::endl;
+    }
+    return 0;
+}
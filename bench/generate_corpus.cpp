@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include "src/util.h"
+
+// exponent of Heaps' law, V(n) ~ n^beta, by which the vocabulary of each class grows with the number
+// of emails generated for it, beyond the vocabulary seen in the training data
+#define CORPUS_HEAPS_EXPONENT 0.5
+
+// words seen fewer times than this are left out when fitting the Zipf exponent, since the tail of
+// singletons would dominate a least-squares fit on a log-log scale
+#define CORPUS_FIT_MIN_FREQ 3
+
+// prefix of the words ranked beyond the vocabulary seen in the training data
+#define CORPUS_SYNTHETIC_WORD_PREFIX "qx"
+
+/**** type definitions ****/
+
+// distributions learned from the training emails of one class
+struct ClassDistribution
+{
+    std::vector<std::string> words_by_rank;                 // seen words, most frequent first
+    std::vector<size_t> email_lengths;                      // number of words of every email
+    std::vector<size_t> line_lengths;                       // number of words of every non-empty line
+    double zipf_exponent = 1.0;                             // s in P(rank k) ~ 1/k^s
+    size_t num_emails = 0;
+};
+
+// samples ranks 1..n with P(k) ~ 1/k^s in constant time, by rejection-inversion
+// (Hormann and Derflinger, "Rejection-inversion to generate variates from monotone discrete distributions")
+struct ZipfSampler
+{
+    double exponent;
+    double h_integral_x1;
+    double h_integral_n;
+    double squeeze;
+    uint64_t num_ranks;
+};
+
+/**** function prototypes ****/
+uint64_t next_random(uint64_t&);
+double next_uniform(uint64_t&);
+size_t next_index(uint64_t&, size_t);
+ClassDistribution learn_class_distribution(const FileList&);
+double fit_zipf_exponent(const std::vector<size_t>&);
+double zipf_h_integral(double, double);
+double zipf_h_integral_inverse(double, double);
+ZipfSampler make_zipf_sampler(double, uint64_t);
+uint64_t sample_zipf(const ZipfSampler&, uint64_t&);
+std::string get_ranked_word(const ClassDistribution&, uint64_t);
+std::string generate_email(const ClassDistribution&, const ZipfSampler&, uint64_t&);
+
+/**** functions ****/
+
+/**
+ * steps a splitmix64 generator. the generator is written out rather than taken from <random>, so
+ * that the same seed gives the same corpus with every standard library
+ */
+uint64_t next_random(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * draws a double uniformly from [0, 1)
+ */
+double next_uniform(uint64_t& state)
+{
+    return (double) (next_random(state) >> 11) * 0x1.0p-53;
+}
+
+/**
+ * draws an index uniformly from [0, size)
+ */
+size_t next_index(uint64_t& state, size_t size)
+{
+    return (size_t) (((unsigned __int128) next_random(state) * size) >> 64);
+}
+
+/**
+ * learns the word frequencies, and the distributions of email and line lengths, of a class
+ */
+ClassDistribution learn_class_distribution(const FileList& files)
+{
+    ClassDistribution distribution;
+    FreqDict word_freq;
+    std::string contents;
+
+    for (const FilePath& file : files)
+    {
+        if (!read_file(file, contents))
+            continue;
+        ++distribution.num_emails;
+
+        size_t email_length = 0, line_length = 0;
+        std::string word;
+        for (size_t i = 0; i <= contents.size(); ++i)
+        {
+            char c = (i < contents.size()) ? contents[i] : '\n';
+            if (!std::isspace((unsigned char) c))
+                word.push_back(c);
+            else if (!word.empty())
+            {
+                ++word_freq[word];
+                ++line_length;
+                word.clear();
+            }
+            if (c == '\n' && line_length > 0)
+            {
+                distribution.line_lengths.push_back(line_length);
+                email_length += line_length;
+                line_length = 0;
+            }
+        }
+        distribution.email_lengths.push_back(email_length);
+    }
+    if (distribution.num_emails == 0 || word_freq.empty())
+        throw std::runtime_error("no words to learn from");
+
+    // most frequent words first, and words seen as often in lexicographic order, so that ranks do
+    // not depend on the layout of the dictionary
+    std::vector<std::pair<size_t, std::string>> ranked;
+    ranked.reserve(word_freq.size());
+    for (const auto& word : word_freq)
+        ranked.emplace_back(word.second, word.first);
+    std::sort(ranked.begin(), ranked.end(), [](const std::pair<size_t, std::string>& a, const std::pair<size_t, std::string>& b)
+    {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+
+    std::vector<size_t> freq_by_rank;
+    for (const auto& word : ranked)
+    {
+        distribution.words_by_rank.push_back(word.second);
+        freq_by_rank.push_back(word.first);
+    }
+    distribution.zipf_exponent = fit_zipf_exponent(freq_by_rank);
+    return distribution;
+}
+
+/**
+ * fits the exponent s of P(rank k) ~ 1/k^s, by least squares on ln(freq) = c - s ln(k), over the
+ * words seen at least CORPUS_FIT_MIN_FREQ times
+ */
+double fit_zipf_exponent(const std::vector<size_t>& freq_by_rank)
+{
+    double n = 0.0, sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+    for (size_t k = 0; k < freq_by_rank.size() && freq_by_rank[k] >= CORPUS_FIT_MIN_FREQ; ++k)
+    {
+        double x = std::log((double) (k + 1)), y = std::log((double) freq_by_rank[k]);
+        n += 1.0;
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+    if (n < 2.0)
+        return 1.0;
+
+    double slope = (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+    return std::max(0.1, -slope);
+}
+
+/**
+ * integral of 1/x^s, (x^(1-s) - 1)/(1-s), written so that it stays accurate when s is close to 1
+ */
+double zipf_h_integral(double x, double s)
+{
+    double log_x = std::log(x), t = (1.0 - s) * log_x;
+    double expm1_over_t = (std::fabs(t) > 1e-8) ? std::expm1(t) / t : 1.0 + t / 2.0;
+    return expm1_over_t * log_x;
+}
+
+/**
+ * inverse of zipf_h_integral()
+ */
+double zipf_h_integral_inverse(double x, double s)
+{
+    // t >= -1 in exact arithmetic; rounding may take it just below, where log1p is not defined
+    double t = std::max(x * (1.0 - s), -1.0);
+    double log1p_over_t = (std::fabs(t) > 1e-8) ? std::log1p(t) / t : 1.0 - t / 2.0;
+    return std::exp(log1p_over_t * x);
+}
+
+/**
+ * prepares the constants of rejection-inversion sampling for ranks 1..num_ranks
+ */
+ZipfSampler make_zipf_sampler(double exponent, uint64_t num_ranks)
+{
+    ZipfSampler sampler;
+    sampler.exponent = exponent;
+    sampler.num_ranks = num_ranks;
+    sampler.h_integral_x1 = zipf_h_integral(1.5, exponent) - 1.0;
+    sampler.h_integral_n = zipf_h_integral((double) num_ranks + 0.5, exponent);
+    sampler.squeeze = 2.0 - zipf_h_integral_inverse(zipf_h_integral(2.5, exponent) - std::pow(2.0, -exponent), exponent);
+    return sampler;
+}
+
+/**
+ * draws a rank
+ */
+uint64_t sample_zipf(const ZipfSampler& sampler, uint64_t& state)
+{
+    while (true)
+    {
+        double u = sampler.h_integral_n + next_uniform(state) * (sampler.h_integral_x1 - sampler.h_integral_n);
+        double x = zipf_h_integral_inverse(u, sampler.exponent);
+        uint64_t k = (uint64_t) std::max(1.0, std::min((double) sampler.num_ranks, std::floor(x + 0.5)));
+
+        if ((double) k - x <= sampler.squeeze
+            || u >= zipf_h_integral((double) k + 0.5, sampler.exponent) - std::pow((double) k, -sampler.exponent))
+            return k;
+    }
+}
+
+/**
+ * gets the word of a rank: a seen word, or beyond the seen vocabulary, the rank spelled out in
+ * lowercase letters after CORPUS_SYNTHETIC_WORD_PREFIX
+ */
+std::string get_ranked_word(const ClassDistribution& distribution, uint64_t rank)
+{
+    if (rank <= distribution.words_by_rank.size())
+        return distribution.words_by_rank[rank - 1];
+
+    std::string word = CORPUS_SYNTHETIC_WORD_PREFIX;
+    for (uint64_t i = rank; i > 0; i /= 26)
+        word.push_back((char) ('a' + i % 26));
+    return word;
+}
+
+/**
+ * generates an email: its number of words, and the number of words of each of its lines, are drawn
+ * from those of the training emails, and its words by rank from the fitted Zipf distribution
+ */
+std::string generate_email(const ClassDistribution& distribution, const ZipfSampler& sampler, uint64_t& state)
+{
+    std::string email;
+    size_t num_words = std::max<size_t>(1, distribution.email_lengths[next_index(state, distribution.email_lengths.size())]);
+
+    while (num_words > 0)
+    {
+        size_t line_length = distribution.line_lengths[next_index(state, distribution.line_lengths.size())];
+        line_length = std::min(std::max<size_t>(1, line_length), num_words);
+        num_words -= line_length;
+
+        for (size_t i = 0; i < line_length; ++i)
+        {
+            if (i > 0)
+                email.push_back(' ');
+            email += get_ranked_word(distribution, sample_zipf(sampler, state));
+        }
+        email.push_back('\n');
+    }
+    return email;
+}
+
+/**** main ****/
+// generate_corpus <out_dir> <num_training_emails> <num_test_emails> [seed] [spam_dir ham_dir] :
+// learns word frequencies and email lengths from labeled emails (../data/spam and ../data/ham by
+// default), and writes a synthetic corpus as <out_dir>/spam, <out_dir>/ham and <out_dir>/testing
+int main(int argc, char* argv[])
+{
+    if (argc != 4 && argc != 5 && argc != 7)
+    {
+        std::cerr << "usage: generate_corpus <out_dir> <num_training_emails> <num_test_emails> [seed] [spam_dir ham_dir]"
+                  << std::endl;
+        return 1;
+    }
+    DirPath out_dir = argv[1];
+    uint64_t num_training, num_test, seed;
+    try
+    {
+        num_training = std::stoull(argv[2]);
+        num_test = std::stoull(argv[3]);
+        seed = (argc > 4) ? std::stoull(argv[4]) : 1;
+    }
+    catch (const std::logic_error&)
+    {
+        std::cerr << "usage: generate_corpus <out_dir> <num_training_emails> <num_test_emails> [seed] [spam_dir ham_dir]"
+                  << std::endl;
+        return 1;
+    }
+    DirPath spam_dir = (argc > 6) ? argv[5] : "../data/spam/";
+    DirPath ham_dir = (argc > 6) ? argv[6] : "../data/ham/";
+
+    std::array<ClassDistribution, 2> distributions;
+    try
+    {
+        distributions = {learn_class_distribution(get_files_in_folder(spam_dir)),
+                         learn_class_distribution(get_files_in_folder(ham_dir))};
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << "cannot learn from emails: " << error.what() << std::endl;
+        return 1;
+    }
+    double spam_fraction = (double) distributions[EmailClass::SPAM].num_emails
+        / (double) (distributions[EmailClass::SPAM].num_emails + distributions[EmailClass::HAM].num_emails);
+
+    // the vocabulary of each class grows with the number of its emails, following Heaps' law
+    std::array<ZipfSampler, 2> samplers;
+    for (int c = 0; c < 2; ++c)
+    {
+        double expected_emails = (double) (num_training + num_test) * (c == EmailClass::SPAM ? spam_fraction : 1.0 - spam_fraction);
+        double growth = std::max(1.0, std::pow(expected_emails / (double) distributions[c].num_emails, CORPUS_HEAPS_EXPONENT));
+        samplers[c] = make_zipf_sampler(distributions[c].zipf_exponent,
+                                        (uint64_t) std::ceil(growth * (double) distributions[c].words_by_rank.size()));
+        std::cout << (c == EmailClass::SPAM ? "spam" : "ham") << ": " << distributions[c].num_emails << " emails, "
+                  << distributions[c].words_by_rank.size() << " words, Zipf exponent " << distributions[c].zipf_exponent
+                  << ", generating from " << samplers[c].num_ranks << " words" << std::endl;
+    }
+
+    const char* folders[] = {"spam", "ham", "testing"};
+    for (const char* folder : folders)
+        fs::create_directories(fs::path(out_dir) / folder);
+
+    // every email is generated from its own state, derived from the seed and its index, so that
+    // the corpus does not depend on the number of threads writing it
+    std::atomic<uint64_t> num_failed{0};
+    auto generate_emails = [&](uint64_t first, uint64_t step)
+    {
+        char name[64];
+        for (uint64_t i = first; i < num_training + num_test; i += step)
+        {
+            uint64_t state = seed ^ (i * 0xd1b54a32d192ed03ULL);
+            next_random(state);
+            int c = (next_uniform(state) < spam_fraction) ? EmailClass::SPAM : EmailClass::HAM;
+            std::string email = generate_email(distributions[c], samplers[c], state);
+
+            // names follow those of the data folders, from which get_email_label() tells the class
+            std::snprintf(name, sizeof(name), "%08llu.synthetic.%s.txt", (unsigned long long) i, c == EmailClass::SPAM ? "spam" : "ham");
+            FilePath path = (fs::path(out_dir) / folders[i < num_training ? c : 2] / name).string();
+            std::ofstream file(path, std::ios::binary);
+            if (!file.write(email.data(), (std::streamsize) email.size()))
+                ++num_failed;
+        }
+    };
+
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+        threads.emplace_back(generate_emails, t, num_threads);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::cout << "Wrote " << num_training << " training and " << num_test << " test emails to " << out_dir << std::endl;
+    if (num_failed > 0)
+    {
+        std::cerr << num_failed << " emails could not be written" << std::endl;
+        return 2;
+    }
+    return 0;
+}
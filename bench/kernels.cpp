@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include "src/filter.h"
+
+// sizes, in bytes, of the synthetic emails each kernel is measured on
+#define BENCH_EMAIL_SIZES {1 << 10, 16 << 10, 256 << 10}
+
+// numbers of distinct words the synthetic emails are drawn from
+#define BENCH_VOCABULARY_SIZES {1 << 10, 64 << 10}
+
+// approximate number of bytes of synthetic emails per (email size, vocabulary size) pair
+#define BENCH_CORPUS_BYTES (4 << 20)
+
+// minimum time a kernel is repeated for, so that short kernels are not dominated by timer resolution
+#define BENCH_MIN_NANOSECONDS 200000000
+
+// seed of the generator of synthetic emails, so that every run measures the same emails
+#define BENCH_SEED 20240601
+
+/**** type definitions ****/
+
+// synthetic emails, written to a temporary folder, half of them labeled spam and half ham
+struct BenchCorpus
+{
+    DirPath dir;
+    FileListPair files;
+    FileList all_files;
+    std::vector<FreqDict> freq_by_email;
+    size_t num_bytes = 0;
+    size_t num_tokens = 0;
+};
+
+// measurements of a kernel, per email it processed
+struct BenchResult
+{
+    double ns_per_email;
+    double bytes_per_second;
+    double tokens_per_second;
+    double allocations_per_email;
+};
+
+/**** global variables ****/
+
+// number of calls to operator new since the start of the program
+std::atomic<size_t> num_allocations{0};
+
+/**** function prototypes ****/
+std::string get_vocabulary_word(size_t);
+BenchCorpus make_corpus(const DirPath&, size_t, size_t);
+BenchResult run_kernel(const BenchCorpus&, const std::function<void()>&);
+
+/**** allocation counting ****/
+
+// the scalar overrides are kept out of line so that the compiler never sees std::malloc and std::free
+// paired with operator new and operator delete at an inlined call site
+[[gnu::noinline]] void* operator new(size_t size)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+/**** functions ****/
+
+/**
+ * spells out a word of the synthetic vocabulary: its index, in base 26, written with lowercase letters
+ */
+std::string get_vocabulary_word(size_t index)
+{
+    std::string word;
+    do
+    {
+        word.push_back((char) ('a' + index % 26));
+        index /= 26;
+    } while (index > 0);
+    return word;
+}
+
+/**
+ * writes synthetic emails of about email_bytes bytes each, made of words drawn uniformly from a
+ * vocabulary of vocabulary_size words, to a new folder in parent_dir
+ */
+BenchCorpus make_corpus(const DirPath& parent_dir, size_t email_bytes, size_t vocabulary_size)
+{
+    BenchCorpus corpus;
+    corpus.dir = parent_dir + "/bench-" + std::to_string(email_bytes) + "-" + std::to_string(vocabulary_size);
+    fs::create_directories(corpus.dir);
+
+    std::mt19937_64 generator(BENCH_SEED);
+    std::uniform_int_distribution<size_t> pick_word(0, vocabulary_size - 1);
+    size_t num_emails = std::max<size_t>(2, BENCH_CORPUS_BYTES / email_bytes);
+
+    for (size_t i = 0; i < num_emails; ++i)
+    {
+        std::string email = "Subject:";
+        size_t num_tokens = 1;
+        while (email.size() < email_bytes)
+        {
+            email += (num_tokens % 16 == 0) ? '\n' : ' ';
+            email += get_vocabulary_word(pick_word(generator));
+            ++num_tokens;
+        }
+
+        // file names follow those of the data folders, from which get_email_label() tells the class
+        bool spam = i % 2 == 0;
+        FilePath file = corpus.dir + "/" + std::to_string(i) + (spam ? ".bench.spam.txt" : ".bench.ham.txt");
+        std::ofstream(file, std::ios::binary) << email;
+
+        corpus.files[spam ? EmailClass::SPAM : EmailClass::HAM].push_back(file);
+        corpus.all_files.push_back(file);
+        corpus.freq_by_email.push_back(get_word_freq_in_buffer(email.data(), email.size()));
+        corpus.num_bytes += email.size();
+        corpus.num_tokens += num_tokens;
+    }
+    return corpus;
+}
+
+/**
+ * repeats a kernel, which processes every email of the corpus once per call, for at least
+ * BENCH_MIN_NANOSECONDS, and measures it per email
+ */
+BenchResult run_kernel(const BenchCorpus& corpus, const std::function<void()>& kernel)
+{
+    size_t num_runs = 0;
+    size_t allocations_before = num_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    double elapsed_ns = 0.0;
+    do
+    {
+        kernel();
+        ++num_runs;
+        elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed_ns < BENCH_MIN_NANOSECONDS);
+    size_t allocations = num_allocations.load() - allocations_before;
+
+    double num_emails = (double) num_runs * (double) corpus.all_files.size();
+    return {elapsed_ns / num_emails,
+            (double) num_runs * (double) corpus.num_bytes / elapsed_ns * 1e9,
+            (double) num_runs * (double) corpus.num_tokens / elapsed_ns * 1e9,
+            (double) allocations / num_emails};
+}
+
+/**** main ****/
+// bench [kernel]... : measures the tokenizing, counting, training and scoring kernels (or only the
+// given ones) on synthetic emails of several sizes and vocabulary sizes, written to $TMPDIR
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> selected(argv + 1, argv + argc);
+    const char* tmp_dir = std::getenv("TMPDIR");
+    DirPath parent_dir = (fs::path(tmp_dir ? tmp_dir : "/tmp") / fs::unique_path("spamfilter-bench-%%%%%%%%")).string();
+
+    std::cout << "kernel\temail_bytes\tvocabulary\temails\tns_per_email\tMB_per_s\tMtokens_per_s\tallocs_per_email"
+              << std::endl;
+    for (size_t email_bytes : BENCH_EMAIL_SIZES)
+    {
+        for (size_t vocabulary_size : BENCH_VOCABULARY_SIZES)
+        {
+            BenchCorpus corpus = make_corpus(parent_dir, email_bytes, vocabulary_size);
+            Model model = learn_distributions(corpus.files);
+
+            // results are accumulated into sink, so that the kernels cannot be optimized away
+            size_t sink = 0;
+            Prob score_sink = 0.0;
+            std::vector<std::pair<std::string, std::function<void()>>> kernels = {
+                {"get_words_in_file", [&]()
+                    {
+                        for (const FilePath& file : corpus.all_files)
+                            sink += get_words_in_file(file).size();
+                    }},
+                {"get_word_freq_in_file", [&]()
+                    {
+                        for (const FilePath& file : corpus.all_files)
+                            sink += get_word_freq_in_file(file).size();
+                    }},
+                {"get_word_freq_in_files", [&]()
+                    {
+                        sink += get_word_freq_in_files(corpus.all_files).size();
+                    }},
+                {"learn_distributions", [&]()
+                    {
+                        sink += learn_distributions(corpus.files).freq_by_category[0].size();
+                    }},
+                {"prob_class_intrsct_words", [&]()
+                    {
+                        for (const FreqDict& word_freq : corpus.freq_by_email)
+                            score_sink += prob_class_intrsct_words(model, word_freq, EmailClass::SPAM);
+                    }},
+                {"classify_new_email", [&]()
+                    {
+                        for (const FilePath& file : corpus.all_files)
+                            sink += classify_new_email(file, model).first;
+                    }},
+            };
+
+            for (const auto& kernel : kernels)
+            {
+                if (!selected.empty() && std::find(selected.begin(), selected.end(), kernel.first) == selected.end())
+                    continue;
+
+                BenchResult result = run_kernel(corpus, kernel.second);
+                std::cout << kernel.first << "\t" << email_bytes << "\t" << vocabulary_size << "\t"
+                          << corpus.all_files.size() << "\t" << std::fixed << std::setprecision(0)
+                          << result.ns_per_email << "\t" << std::setprecision(1)
+                          << result.bytes_per_second / 1e6 << "\t" << std::setprecision(2)
+                          << result.tokens_per_second / 1e6 << "\t" << std::setprecision(1)
+                          << result.allocations_per_email << std::defaultfloat << std::endl;
+            }
+            if (sink == 0 && score_sink == 0.0)
+                std::cout << "(no work was done)" << std::endl;
+
+            fs::remove_all(corpus.dir);
+        }
+    }
+    fs::remove_all(parent_dir);
+    return 0;
+}
@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include "src/batch.h"
+#include "src/filter.h"
+#include "src/model_store.h"
+#include "src/online_model.h"
+#include "src/scheduler.h"
+#include "src/spam_filter.h"
+
+// default relative tolerance on the log posteriors of an engine, against those of the reference
+#define ORACLE_DEFAULT_TOLERANCE 1e-9
+
+// default number of mutated emails, on top of the fixed adversarial inputs
+#define ORACLE_DEFAULT_NUM_FUZZED 200
+
+// number of threads of the parallel engine; more than one, so that it runs on the scheduler
+#define ORACLE_NUM_THREADS 4
+
+// maximum number of times an input is classified while minimizing a divergence
+#define ORACLE_MAX_MINIMIZE_STEPS 2000
+
+// number of bytes of a minimized input that are printed
+#define ORACLE_PREVIEW_BYTES 200
+
+/**** type definitions ****/
+
+// a way of classifying emails, checked against classify_new_email()
+struct Engine
+{
+    std::string name;
+    bool same_scores;                                       // false if only the verdicts must match
+    std::function<std::vector<Classification>(const FileList&)> classify;
+};
+
+/**** function prototypes ****/
+uint64_t next_random(uint64_t&);
+size_t next_index(uint64_t&, size_t);
+std::vector<Engine> get_engines(const FilePath&, const Model&, double);
+Classification parse_batch_line(const std::string&);
+bool is_divergent(const Classification&, const Classification&, bool, double);
+std::vector<std::string> make_fuzzed_inputs(const FileList&, const Model&, size_t, uint64_t);
+std::string minimize_input(const std::string&, const std::function<bool(const std::string&)>&);
+std::string escape_input(const std::string&);
+
+/**** functions ****/
+
+/**
+ * steps a splitmix64 generator, so that the same seed gives the same inputs with every standard library
+ */
+uint64_t next_random(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * draws an index uniformly from [0, size)
+ */
+size_t next_index(uint64_t& state, size_t size)
+{
+    return (size_t) (((unsigned __int128) next_random(state) * size) >> 64);
+}
+
+/**
+ * lists the engines checked against the reference. early exit stops reading once the verdict is
+ * settled, so only its verdicts must match; the others must also agree on the log posteriors. the
+ * C interface and batch classification load the model from its file themselves
+ */
+std::vector<Engine> get_engines(const FilePath& model_path, const Model& model, double zeta)
+{
+    std::shared_ptr<bsf_model> c_model(bsf_model_load(model_path.c_str()), bsf_model_free);
+    auto shared_model = std::make_shared<const Model>(model);
+    auto online_model = std::make_shared<OnlineModel>();
+    publish_model(*online_model, model);
+    size_t reader = register_reader(*online_model);
+    auto store = std::make_shared<ModelStore>();
+    store->base = shared_model;
+
+    return {
+        {"buffer", true, [shared_model, zeta](const FileList& files)
+            {
+                std::vector<Classification> results;
+                std::string contents;
+                for (const FilePath& file : files)
+                {
+                    read_file(file, contents);
+                    results.push_back(classify_new_email_buffer(contents.data(), contents.size(), *shared_model, zeta));
+                }
+                return results;
+            }},
+        {"parallel", true, [shared_model, zeta](const FileList& files)
+            {
+                std::vector<size_t> bytes_saved;
+                std::vector<char> truncated;
+                return classify_files(files, *shared_model, zeta, ScoringMode::FULL_SCAN, ORACLE_NUM_THREADS,
+                                      bytes_saved, truncated);
+            }},
+        {"streaming", true, [shared_model, zeta](const FileList& files)
+            {
+                std::vector<Classification> results;
+                for (const FilePath& file : files)
+                {
+                    bool truncated = false;
+                    results.push_back(classify_new_email_streaming(file, *shared_model, truncated, SIZE_MAX, zeta));
+                }
+                return results;
+            }},
+        {"early_exit", false, [shared_model, zeta](const FileList& files)
+            {
+                std::vector<Classification> results;
+                LogProbBounds log_prob_bounds = get_log_prob_bounds(*shared_model);
+                for (const FilePath& file : files)
+                {
+                    size_t bytes_saved = 0;
+                    results.push_back(classify_new_email_early_exit(file, *shared_model, log_prob_bounds, bytes_saved, zeta));
+                }
+                return results;
+            }},
+        {"online_model", true, [online_model, reader, zeta](const FileList& files)
+            {
+                std::vector<Classification> results;
+                std::string contents;
+                for (const FilePath& file : files)
+                {
+                    read_file(file, contents);
+                    const ModelSnapshot* snapshot = enter_snapshot(*online_model, reader);
+                    results.push_back(classify_snapshot(*snapshot, get_word_freq_in_buffer(contents.data(), contents.size()), zeta));
+                    leave_snapshot(*online_model, reader);
+                }
+                return results;
+            }},
+        {"model_store", true, [store, zeta](const FileList& files)
+            {
+                std::vector<Classification> results;
+                std::string contents;
+                for (const FilePath& file : files)
+                {
+                    read_file(file, contents);
+                    results.push_back(classify_user_email(*store, "oracle", contents.data(), contents.size(), zeta));
+                }
+                return results;
+            }},
+        {"bsf_classify", true, [c_model, zeta](const FileList& files)
+            {
+                // a failed call gets NaN scores, which always diverge
+                std::vector<Classification> results;
+                std::string contents;
+                for (const FilePath& file : files)
+                {
+                    read_file(file, contents);
+                    bsf_result result;
+                    if (bsf_classify(c_model.get(), contents.data(), contents.size(), zeta, &result) != 0)
+                        results.push_back(parse_batch_line(""));
+                    else
+                        results.push_back({result.is_spam ? EmailClass::SPAM : EmailClass::HAM,
+                                           {result.log_prob_spam, result.log_prob_ham}});
+                }
+                return results;
+            }},
+        {"batch", true, [model_path, zeta](const FileList& files)
+            {
+                std::string paths;
+                for (const FilePath& file : files)
+                    paths += file + '\0';
+                std::istringstream in(paths);
+                std::ostringstream out;
+                classify_batch(model_path, in, out, '\0', zeta, ORACLE_NUM_THREADS);
+
+                std::vector<Classification> results;
+                std::istringstream lines(out.str());
+                std::string line;
+                while (results.size() < files.size())
+                    results.push_back(parse_batch_line(std::getline(lines, line) ? line : ""));
+                return results;
+            }},
+    };
+}
+
+/**
+ * parses a verdict line of classify_batch(); lines that are missing or report an error get NaN
+ * scores, which always diverge
+ */
+Classification parse_batch_line(const std::string& line)
+{
+    Prob nan = std::numeric_limits<Prob>::quiet_NaN();
+    size_t ham_begin = line.rfind('\t');
+    size_t spam_begin = (ham_begin == std::string::npos || ham_begin == 0) ? std::string::npos : line.rfind('\t', ham_begin - 1);
+    size_t class_begin = (spam_begin == std::string::npos || spam_begin == 0) ? std::string::npos : line.rfind('\t', spam_begin - 1);
+    if (class_begin == std::string::npos)
+        return {EmailClass::HAM, {nan, nan}};
+
+    std::string email_class = line.substr(class_begin + 1, spam_begin - class_begin - 1);
+    try
+    {
+        return {email_class == "SPAM" ? EmailClass::SPAM : EmailClass::HAM,
+                {std::stold(line.substr(spam_begin + 1, ham_begin - spam_begin - 1)), std::stold(line.substr(ham_begin + 1))}};
+    }
+    catch (const std::logic_error&)
+    {
+        return {EmailClass::HAM, {nan, nan}};
+    }
+}
+
+/**
+ * checks whether an engine disagrees with the reference on an email: on the verdict, or on either
+ * log posterior by more than the relative tolerance
+ */
+bool is_divergent(const Classification& reference, const Classification& result, bool same_scores, double tolerance)
+{
+    if (reference.first != result.first)
+        return true;
+    if (!same_scores)
+        return false;
+
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        Prob expected = reference.second[c], actual = result.second[c];
+        if (std::isnan((double) expected) != std::isnan((double) actual))
+            return true;
+        if (std::fabs((double) (expected - actual)) > tolerance * std::max(1.0, std::fabs((double) expected)))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * makes inputs that differ from ordinary emails where engines are most likely to disagree: no words,
+ * only whitespace, binary bytes, words far longer than a range of a split email or cut by the
+ * boundary between two ranges, heavily repeated words, CRLF line endings, and mutations of real emails
+ */
+std::vector<std::string> make_fuzzed_inputs(const FileList& emails, const Model& model, size_t num_fuzzed, uint64_t seed)
+{
+    uint64_t state = seed;
+    std::vector<std::string> inputs = {"", " ", "\n", " \t\n\v\f\r ", "word", std::string(1, '\0'), "\xff\xfe\x80"};
+
+    // words the model knows, in a fixed order
+    std::vector<std::string> words;
+    for (const FreqDict& freq_dict : model.freq_by_category)
+        for (const FreqDict::value_type* word : get_sorted_words(freq_dict))
+            words.push_back(word->first);
+    auto pick_word = [&]() { return words.empty() ? std::string("word") : words[next_index(state, words.size())]; };
+
+    std::string binary(4096, '\0');
+    for (char& c : binary)
+        c = (char) next_random(state);
+    inputs.push_back(binary);
+
+    inputs.push_back(std::string(SCHEDULER_SPLIT_BYTES + 4096, 'x'));
+
+    std::string straddling;
+    while (straddling.size() < SCHEDULER_SPLIT_BYTES - 3)
+        straddling += pick_word() + " ";
+    straddling.resize(SCHEDULER_SPLIT_BYTES - 3);
+    straddling += "straddlingword " + pick_word();
+    inputs.push_back(straddling);
+
+    std::string repeated;
+    std::string word = pick_word();
+    for (size_t i = 0; i < 100000; ++i)
+        repeated += word + "\n";
+    inputs.push_back(repeated);
+
+    std::string contents;
+    for (size_t i = 0; i < num_fuzzed && !emails.empty(); ++i)
+    {
+        if (!read_file(emails[next_index(state, emails.size())], contents))
+            continue;
+
+        if (i % 10 == 0)
+        {
+            std::string crlf;
+            for (char c : contents)
+                crlf += (c == '\n') ? std::string("\r\n") : std::string(1, c);
+            inputs.push_back(crlf);
+            continue;
+        }
+
+        size_t num_mutations = 1 + next_index(state, 8);
+        for (size_t m = 0; m < num_mutations; ++m)
+        {
+            size_t position = next_index(state, contents.size() + 1);
+            switch (next_index(state, 5))
+            {
+                case 0:
+                    if (position < contents.size())
+                        contents[position] = (char) next_random(state);
+                    break;
+                case 1:
+                    contents.insert(position, 1, " \t\n\v\f\r"[next_index(state, 6)]);
+                    break;
+                case 2:
+                    contents.erase(position, next_index(state, 64));
+                    break;
+                case 3:
+                    contents.insert(position, contents.substr(position, next_index(state, 256)));
+                    break;
+                default:
+                    contents.insert(position, " " + pick_word() + " ");
+                    break;
+            }
+        }
+        inputs.push_back(contents);
+    }
+    return inputs;
+}
+
+/**
+ * shrinks an input while it still makes an engine diverge, by removing ever smaller chunks of it
+ * (delta debugging)
+ *
+ * @param input : input on which the engine diverges
+ * @param diverges : whether the engine diverges on an input
+ * @return a smaller input on which it still diverges, from which no single chunk can be removed
+ */
+std::string minimize_input(const std::string& input, const std::function<bool(const std::string&)>& diverges)
+{
+    std::string minimal = input;
+    size_t num_chunks = 2, num_steps = 0;
+    while (minimal.size() > 1 && num_steps < ORACLE_MAX_MINIMIZE_STEPS)
+    {
+        size_t chunk_size = (minimal.size() + num_chunks - 1) / num_chunks;
+        bool removed = false;
+        for (size_t begin = 0; begin < minimal.size() && num_steps < ORACLE_MAX_MINIMIZE_STEPS; begin += chunk_size)
+        {
+            std::string candidate = minimal.substr(0, begin) + minimal.substr(std::min(minimal.size(), begin + chunk_size));
+            ++num_steps;
+            if (diverges(candidate))
+            {
+                minimal = candidate;
+                num_chunks = std::max<size_t>(num_chunks - 1, 2);
+                removed = true;
+                break;
+            }
+        }
+        if (!removed)
+        {
+            if (chunk_size == 1)
+                break;
+            num_chunks = std::min(minimal.size(), 2 * num_chunks);
+        }
+    }
+    return minimal;
+}
+
+/**
+ * writes the first bytes of an input with its non-printable characters escaped
+ */
+std::string escape_input(const std::string& input)
+{
+    std::ostringstream escaped;
+    for (size_t i = 0; i < std::min<size_t>(input.size(), ORACLE_PREVIEW_BYTES); ++i)
+    {
+        unsigned char c = (unsigned char) input[i];
+        if (c == '\\')
+            escaped << "\\\\";
+        else if (c >= 0x20 && c < 0x7f)
+            escaped << (char) c;
+        else
+            escaped << "\\x" << std::hex << std::setw(2) << std::setfill('0') << (int) c << std::dec;
+    }
+    if (input.size() > ORACLE_PREVIEW_BYTES)
+        escaped << "...";
+    return escaped.str();
+}
+
+/**** main ****/
+// oracle <model_path> [-z zeta] [-e tolerance] [-f num_fuzzed] [-s seed] [-o out_dir] [email_dir]... :
+// classifies the emails of the folders, and fuzzed inputs made from them, with every engine and with
+// classify_new_email(), the reference. verdicts must be identical, and log posteriors within the
+// relative tolerance; every divergence is reported with the smallest input found to still cause it,
+// also written to out_dir if given. exits with 3 if any engine diverged
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: oracle <model_path> [-z zeta] [-e tolerance] [-f num_fuzzed] [-s seed] [-o out_dir]"
+                  << " [email_dir]..." << std::endl;
+        return 1;
+    }
+    double zeta = 0.88, tolerance = ORACLE_DEFAULT_TOLERANCE;
+    size_t num_fuzzed = ORACLE_DEFAULT_NUM_FUZZED;
+    uint64_t seed = 1;
+    DirPath out_dir;
+    std::vector<DirPath> email_dirs;
+    try
+    {
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc)
+            {
+                std::string value = argv[++i];
+                if (arg == "-z")
+                    zeta = std::stod(value);
+                else if (arg == "-e")
+                    tolerance = std::stod(value);
+                else if (arg == "-f")
+                    num_fuzzed = std::stoul(value);
+                else if (arg == "-s")
+                    seed = std::stoull(value);
+                else if (arg == "-o")
+                    out_dir = value;
+                else
+                {
+                    std::cerr << "unknown option " << arg << std::endl;
+                    return 1;
+                }
+            }
+            else
+                email_dirs.push_back(arg);
+        }
+    }
+    catch (const std::logic_error&)
+    {
+        std::cerr << "usage: oracle <model_path> [-z zeta] [-e tolerance] [-f num_fuzzed] [-s seed] [-o out_dir]"
+                  << " [email_dir]..." << std::endl;
+        return 1;
+    }
+
+    Model model;
+    try
+    {
+        model = load_model(argv[1]);
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << "cannot load model: " << error.what() << std::endl;
+        return 1;
+    }
+    FileList emails;
+    try
+    {
+        for (const DirPath& dir : email_dirs)
+        {
+            FileList files = get_files_in_folder(dir);
+            emails.insert(emails.end(), files.begin(), files.end());
+        }
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << "cannot read emails: " << error.what() << std::endl;
+        return 1;
+    }
+
+    // fuzzed inputs are classified from files too, since the reference reads its email from a file
+    const char* tmp_dir = std::getenv("TMPDIR");
+    fs::path work_dir = fs::path(tmp_dir ? tmp_dir : "/tmp") / fs::unique_path("spamfilter-oracle-%%%%%%%%");
+    fs::create_directories(work_dir);
+    FileList inputs = emails;
+    std::vector<std::string> fuzzed = make_fuzzed_inputs(emails, model, num_fuzzed, seed);
+    for (size_t i = 0; i < fuzzed.size(); ++i)
+    {
+        inputs.push_back((work_dir / ("fuzzed-" + std::to_string(i) + ".txt")).string());
+        std::ofstream(inputs.back(), std::ios::binary) << fuzzed[i];
+    }
+
+    std::vector<Classification> reference;
+    for (const FilePath& input : inputs)
+        reference.push_back(classify_new_email(input, model, zeta));
+
+    size_t num_divergences = 0;
+    FilePath candidate_file = (work_dir / "candidate.txt").string();
+    for (const Engine& engine : get_engines(argv[1], model, zeta))
+    {
+        std::vector<Classification> results = engine.classify(inputs);
+        size_t num_engine_divergences = 0;
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            if (!is_divergent(reference[i], results[i], engine.same_scores, tolerance))
+                continue;
+            ++num_engine_divergences;
+
+            auto diverges = [&](const std::string& candidate)
+            {
+                std::ofstream(candidate_file, std::ios::binary | std::ios::trunc) << candidate;
+                return is_divergent(classify_new_email(candidate_file, model, zeta), engine.classify({candidate_file})[0],
+                                    engine.same_scores, tolerance);
+            };
+            std::string input;
+            read_file(inputs[i], input);
+            std::string minimal = minimize_input(input, diverges);
+
+            std::cout << std::setprecision(17) << engine.name << ": " << inputs[i] << ": reference "
+                      << (reference[i].first == EmailClass::SPAM ? "SPAM" : "HAM") << " " << reference[i].second[0] << " "
+                      << reference[i].second[1] << ", engine " << (results[i].first == EmailClass::SPAM ? "SPAM" : "HAM")
+                      << " " << results[i].second[0] << " " << results[i].second[1] << std::setprecision(6) << "\n"
+                      << "  minimal input (" << minimal.size() << " bytes): \"" << escape_input(minimal) << "\"" << std::endl;
+            if (!out_dir.empty())
+            {
+                fs::create_directories(out_dir);
+                std::ofstream(out_dir + "/" + engine.name + "-" + std::to_string(num_divergences + num_engine_divergences)
+                              + ".txt", std::ios::binary) << minimal;
+            }
+        }
+        std::cout << engine.name << ": " << num_engine_divergences << " divergences in " << inputs.size() << " inputs" << std::endl;
+        num_divergences += num_engine_divergences;
+    }
+
+    fs::remove_all(work_dir);
+    return num_divergences > 0 ? 3 : 0;
+}
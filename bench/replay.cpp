@@ -0,0 +1,333 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "src/filter.h"
+
+// number of bits of precision of the latency histogram: latencies are recorded to within 2^-(bits - 1),
+// under 1%
+#define REPLAY_HISTOGRAM_BITS 8
+
+// number of buckets of the latency histogram, enough for any 64-bit number of nanoseconds
+#define REPLAY_HISTOGRAM_BUCKETS ((64 - REPLAY_HISTOGRAM_BITS + 2) << (REPLAY_HISTOGRAM_BITS - 1))
+
+// fraction by which a run may be slower than the baseline, in throughput or in any percentile,
+// before it counts as a regression
+#define REPLAY_DEFAULT_THRESHOLD 0.10
+
+/**** type definitions ****/
+
+// histogram of latencies in nanoseconds, with buckets of constant relative width as in
+// HdrHistogram: values below 2^bits are counted exactly, and larger ones to their top bits
+struct LatencyHistogram
+{
+    std::vector<uint64_t> counts = std::vector<uint64_t>(REPLAY_HISTOGRAM_BUCKETS, 0);
+    uint64_t total = 0;
+    uint64_t max = 0;
+};
+
+// results of a replay, as written to and read from a baseline file
+struct ReplayReport
+{
+    double messages_per_second = 0.0;
+    double mb_per_second = 0.0;
+    double p50_ns = 0.0;
+    double p99_ns = 0.0;
+    double p999_ns = 0.0;
+};
+
+/**** function prototypes ****/
+size_t get_histogram_bucket(uint64_t);
+uint64_t get_bucket_highest_value(size_t);
+void record_latency(LatencyHistogram&, uint64_t);
+void merge_histograms(LatencyHistogram&, const LatencyHistogram&);
+uint64_t get_percentile(const LatencyHistogram&, double);
+std::string report_to_json(const ReplayReport&, size_t, size_t, double);
+bool load_report(const FilePath&, ReplayReport&);
+bool compare_reports(const ReplayReport&, const ReplayReport&, double);
+
+/**** functions ****/
+
+/**
+ * gets the bucket a latency is counted in
+ */
+size_t get_histogram_bucket(uint64_t value)
+{
+    if (value < (1ULL << REPLAY_HISTOGRAM_BITS))
+        return (size_t) value;
+
+    // shift so that the top REPLAY_HISTOGRAM_BITS bits of the value are kept; the shifted value is
+    // then in [2^(bits-1), 2^bits), so every shift gets its own 2^(bits-1) buckets
+    int shift = (63 - __builtin_clzll(value)) - (REPLAY_HISTOGRAM_BITS - 1);
+    return ((size_t) shift << (REPLAY_HISTOGRAM_BITS - 1)) + (size_t) (value >> shift);
+}
+
+/**
+ * gets the highest latency counted in a bucket
+ */
+uint64_t get_bucket_highest_value(size_t bucket)
+{
+    if (bucket < (1ULL << REPLAY_HISTOGRAM_BITS))
+        return bucket;
+
+    size_t half = (size_t) 1 << (REPLAY_HISTOGRAM_BITS - 1);
+    size_t shift = bucket / half - 1;
+    uint64_t top_bits = bucket - shift * half;
+    return ((top_bits + 1) << shift) - 1;
+}
+
+/**
+ * counts a latency
+ */
+void record_latency(LatencyHistogram& histogram, uint64_t value)
+{
+    ++histogram.counts[get_histogram_bucket(value)];
+    ++histogram.total;
+    histogram.max = std::max(histogram.max, value);
+}
+
+/**
+ * adds the latencies counted by another histogram
+ */
+void merge_histograms(LatencyHistogram& histogram, const LatencyHistogram& other)
+{
+    for (size_t i = 0; i < histogram.counts.size(); ++i)
+        histogram.counts[i] += other.counts[i];
+    histogram.total += other.total;
+    histogram.max = std::max(histogram.max, other.max);
+}
+
+/**
+ * gets the latency under which the given fraction of the recorded latencies are
+ */
+uint64_t get_percentile(const LatencyHistogram& histogram, double fraction)
+{
+    uint64_t rank = (uint64_t) std::ceil(fraction * (double) histogram.total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.counts.size(); ++i)
+    {
+        seen += histogram.counts[i];
+        if (seen >= std::max<uint64_t>(rank, 1))
+            return std::min(get_bucket_highest_value(i), histogram.max);
+    }
+    return histogram.max;
+}
+
+/**
+ * writes a report as a JSON object, along with the parameters of the run
+ */
+std::string report_to_json(const ReplayReport& report, size_t num_messages, size_t num_threads, double rate)
+{
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(1) << "{\n"
+         << "  \"messages\": " << num_messages << ",\n"
+         << "  \"threads\": " << num_threads << ",\n"
+         << "  \"target_rate\": " << rate << ",\n"
+         << "  \"messages_per_second\": " << report.messages_per_second << ",\n"
+         << "  \"mb_per_second\": " << std::setprecision(3) << report.mb_per_second << ",\n"
+         << "  \"p50_ns\": " << std::setprecision(0) << report.p50_ns << ",\n"
+         << "  \"p99_ns\": " << report.p99_ns << ",\n"
+         << "  \"p999_ns\": " << report.p999_ns << "\n"
+         << "}\n";
+    return json.str();
+}
+
+/**
+ * reads the results of a report written by report_to_json(); only the keys it writes are looked for
+ */
+bool load_report(const FilePath& path, ReplayReport& report)
+{
+    std::string json;
+    if (!read_file(path, json))
+        return false;
+
+    std::pair<const char*, double*> fields[] = {{"messages_per_second", &report.messages_per_second},
+                                                {"mb_per_second", &report.mb_per_second},
+                                                {"p50_ns", &report.p50_ns},
+                                                {"p99_ns", &report.p99_ns},
+                                                {"p999_ns", &report.p999_ns}};
+    for (const auto& field : fields)
+    {
+        size_t key = json.find("\"" + std::string(field.first) + "\"");
+        size_t colon = (key == std::string::npos) ? key : json.find(':', key);
+        if (colon == std::string::npos)
+            return false;
+        *field.second = std::strtod(json.c_str() + colon + 1, nullptr);
+    }
+    return true;
+}
+
+/**
+ * compares a run with a baseline, printing every measure that regressed by more than the threshold
+ *
+ * @return whether nothing regressed
+ */
+bool compare_reports(const ReplayReport& run, const ReplayReport& baseline, double threshold)
+{
+    bool ok = true;
+    auto check = [&](const char* name, double value, double reference, bool higher_is_better)
+    {
+        double change = (reference > 0.0) ? value / reference - 1.0 : 0.0;
+        bool regressed = higher_is_better ? change < -threshold : change > threshold;
+        std::cout << std::fixed << std::setprecision(1) << name << ": " << value << " vs " << reference << " ("
+                  << std::showpos << 100.0 * change << "%" << std::noshowpos << (regressed ? ", REGRESSED" : "")
+                  << ")" << std::defaultfloat << std::endl;
+        ok = ok && !regressed;
+    };
+    check("messages_per_second", run.messages_per_second, baseline.messages_per_second, true);
+    check("mb_per_second", run.mb_per_second, baseline.mb_per_second, true);
+    check("p50_ns", run.p50_ns, baseline.p50_ns, false);
+    check("p99_ns", run.p99_ns, baseline.p99_ns, false);
+    check("p999_ns", run.p999_ns, baseline.p999_ns, false);
+    return ok;
+}
+
+/**** main ****/
+// replay <model_path> <email_dir> [-r rate] [-t threads] [-n passes] [-z zeta] [-o report.json]
+//        [-b baseline.json] [-x threshold] :
+// classifies every email of the folder, n times over, through the full path from the file to the
+// verdict, either as fast as possible or at the given rate in messages per second. reports the
+// throughput and the percentiles of the per-message latency, and with a baseline, exits with 3 if
+// any of them regressed by more than the threshold
+int main(int argc, char* argv[])
+{
+    if (argc < 3 || argc % 2 == 0)
+    {
+        std::cerr << "usage: replay <model_path> <email_dir> [-r rate] [-t threads] [-n passes] [-z zeta]"
+                  << " [-o report.json] [-b baseline.json] [-x threshold]" << std::endl;
+        return 1;
+    }
+    double rate = 0.0, zeta = 0.88, threshold = REPLAY_DEFAULT_THRESHOLD;
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency()), num_passes = 1;
+    FilePath report_path, baseline_path;
+    try
+    {
+        for (int i = 3; i + 1 < argc; i += 2)
+        {
+            std::string flag = argv[i], value = argv[i + 1];
+            if (flag == "-r")
+                rate = std::stod(value);
+            else if (flag == "-t")
+                num_threads = std::max<size_t>(1, std::stoul(value));
+            else if (flag == "-n")
+                num_passes = std::max<size_t>(1, std::stoul(value));
+            else if (flag == "-z")
+                zeta = std::stod(value);
+            else if (flag == "-o")
+                report_path = value;
+            else if (flag == "-b")
+                baseline_path = value;
+            else if (flag == "-x")
+                threshold = std::stod(value);
+            else
+            {
+                std::cerr << "unknown option " << flag << std::endl;
+                return 1;
+            }
+        }
+    }
+    catch (const std::logic_error&)
+    {
+        std::cerr << "usage: replay <model_path> <email_dir> [-r rate] [-t threads] [-n passes] [-z zeta]"
+                  << " [-o report.json] [-b baseline.json] [-x threshold]" << std::endl;
+        return 1;
+    }
+
+    Model model;
+    try
+    {
+        model = load_model(argv[1]);
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << "cannot load model: " << error.what() << std::endl;
+        return 1;
+    }
+    FileList files = get_files_in_folder(argv[2]);
+    if (files.empty())
+    {
+        std::cerr << "no emails in " << argv[2] << std::endl;
+        return 1;
+    }
+    size_t num_messages = num_passes * files.size();
+
+    // sizes are taken before the clock starts, so that no stat() is timed
+    size_t num_bytes = 0;
+    for (const FilePath& file : files)
+    {
+        boost::system::error_code error;
+        uint64_t size = fs::file_size(file, error);
+        num_bytes += error ? 0 : size;
+    }
+    num_bytes *= num_passes;
+
+    // at a target rate, message i is due at start + i/rate, and its latency is measured from then
+    // rather than from when a thread picked it up, so that a stall delays the messages queued
+    // behind it as it would in production (no coordinated omission)
+    std::vector<LatencyHistogram> histogram_by_thread(num_threads);
+    std::atomic<size_t> next_message{0};
+    auto start = std::chrono::steady_clock::now();
+
+    auto replay_messages = [&](size_t t)
+    {
+        for (size_t i = next_message++; i < num_messages; i = next_message++)
+        {
+            auto due = std::chrono::steady_clock::now();
+            if (rate > 0.0)
+            {
+                due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>((double) i / rate));
+                std::this_thread::sleep_until(due);
+            }
+
+            const FilePath& email = files[i % files.size()];
+            classify_new_email(email, model, zeta);
+            auto done = std::chrono::steady_clock::now();
+
+            record_latency(histogram_by_thread[t],
+                           (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(done - due).count());
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+        threads.emplace_back(replay_messages, t);
+    for (std::thread& thread : threads)
+        thread.join();
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LatencyHistogram histogram;
+    for (size_t t = 0; t < num_threads; ++t)
+        merge_histograms(histogram, histogram_by_thread[t]);
+
+    ReplayReport report;
+    report.messages_per_second = (double) num_messages / elapsed_s;
+    report.mb_per_second = (double) num_bytes / elapsed_s / 1e6;
+    report.p50_ns = (double) get_percentile(histogram, 0.50);
+    report.p99_ns = (double) get_percentile(histogram, 0.99);
+    report.p999_ns = (double) get_percentile(histogram, 0.999);
+
+    std::string json = report_to_json(report, num_messages, num_threads, rate);
+    std::cout << json;
+    if (!report_path.empty())
+        std::ofstream(report_path) << json;
+
+    if (!baseline_path.empty())
+    {
+        ReplayReport baseline;
+        if (!load_report(baseline_path, baseline))
+        {
+            std::cerr << "cannot read baseline " << baseline_path << std::endl;
+            return 1;
+        }
+        if (!compare_reports(report, baseline, threshold))
+            return 3;
+    }
+    return 0;
+}
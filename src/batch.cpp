@@ -0,0 +1,174 @@
+#include <future>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "batch.h"
+#include "filter.h"
+#include "ingest.h"
+#include "queue.h"
+
+/**** type definitions ****/
+
+// an email on its way through the stages of a batch
+struct BatchEmail
+{
+    FilePath path;
+    std::string contents;
+    bool readable = false;
+    FreqDict word_freq;
+    std::promise<std::string> line;                         // verdict line handed to the writer
+};
+typedef std::unique_ptr<BatchEmail> BatchEmailPtr;
+
+/**** functions ****/
+
+/**
+ * classifies the emails whose paths are read from an input stream, through a pipeline of a
+ * reader (paths and file contents), tokenizers and scorers connected by bounded queues. the
+ * reader takes up to BATCH_READ_CHUNK paths at a time and reads their files many at once with
+ * read_files(), handing each email on as soon as it was read. one line
+ * "path<TAB>SPAM|HAM<TAB>ln P(SPAM|Email)<TAB>ln P(HAM|Email)" is written per email, in input
+ * order; unreadable files get "path<TAB>ERROR". at most BATCH_WINDOW emails are in flight, which
+ * bounds memory regardless of the number of emails
+ *
+ * @param model_path : path of a model file written by save_model()
+ * @param paths : stream of paths of the emails to be classified
+ * @param out : stream the verdict lines are written to
+ * @param delimiter : character separating the paths, '\n' or '\0'
+ * @param zeta : decision factor; see classify_new_email()
+ * @param num_threads : number of tokenizer threads, of scorer threads, and of pread workers if
+ *  io_uring cannot be used
+ * @return exit status of the batch: 0 if every email was classified, 1 if the model could not be
+ *  loaded, and 2 if some emails could not be read
+ */
+int classify_batch(const FilePath& model_path, std::istream& paths, std::ostream& out, char delimiter,
+    double zeta, size_t num_threads)
+{
+    Model model;
+    try
+    {
+        model = load_model(model_path);
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << "cannot load model: " << error.what() << std::endl;
+        return 1;
+    }
+    num_threads = std::max<size_t>(num_threads, 1);
+
+    // the reader thread must not flush a stream tied to the paths (std::cin is tied to std::cout)
+    // while the writer is writing to it
+    std::ostream* tied = paths.tie(nullptr);
+
+    BoundedQueue<std::future<std::string>> pending(BATCH_WINDOW);
+    BoundedQueue<BatchEmailPtr> to_tokenize(BATCH_QUEUE_CAPACITY);
+    BoundedQueue<BatchEmailPtr> to_score(BATCH_QUEUE_CAPACITY);
+
+    // reader: hands the writer a placeholder for every verdict, in input order, before
+    // reading the files, which then complete in any order
+    std::thread reader([&]()
+    {
+        std::string path;
+        FileList chunk_paths;
+        std::vector<BatchEmailPtr> chunk;
+        auto read_chunk = [&]()
+        {
+            try
+            {
+                read_files(chunk_paths, [&chunk, &to_tokenize](size_t i, std::string& contents, bool readable)
+                {
+                    chunk[i]->contents = std::move(contents);
+                    chunk[i]->readable = readable;
+                    to_tokenize.push(std::move(chunk[i]));
+                }, num_threads);
+            }
+            catch (const std::exception& error)
+            {
+                // the emails not handed on yet are reported as unreadable
+                std::cerr << "cannot read emails: " << error.what() << std::endl;
+                for (BatchEmailPtr& email : chunk)
+                    if (email)
+                        to_tokenize.push(std::move(email));
+            }
+            chunk_paths.clear();
+            chunk.clear();
+        };
+
+        while (std::getline(paths, path, delimiter))
+        {
+            if (path.empty())
+                continue;
+
+            BatchEmailPtr email(new BatchEmail);
+            email->path = path;
+            pending.push(email->line.get_future());
+            chunk_paths.push_back(path);
+            chunk.push_back(std::move(email));
+            if (chunk.size() == BATCH_READ_CHUNK)
+                read_chunk();
+        }
+        read_chunk();
+        to_tokenize.close();
+        pending.close();
+    });
+
+    // tokenizers: contents --> word frequencies
+    std::vector<std::thread> tokenizers;
+    for (size_t i = 0; i < num_threads; ++i)
+        tokenizers.emplace_back([&]()
+        {
+            BatchEmailPtr email;
+            while (to_tokenize.pop(email))
+            {
+                if (email->readable)
+                    email->word_freq = get_word_freq_in_buffer(email->contents.data(), email->contents.size());
+                std::string().swap(email->contents);
+                to_score.push(std::move(email));
+            }
+        });
+
+    // scorers: word frequencies --> verdict line
+    std::vector<std::thread> scorers;
+    for (size_t i = 0; i < num_threads; ++i)
+        scorers.emplace_back([&]()
+        {
+            BatchEmailPtr email;
+            while (to_score.pop(email))
+            {
+                std::ostringstream line;
+                line.precision(17);
+                line << email->path << "\t";
+                if (!email->readable)
+                    line << "ERROR\n";
+                else
+                {
+                    Classification classify_result = classify_word_freq(email->word_freq, model, zeta);
+                    line << (classify_result.first == EmailClass::SPAM ? "SPAM\t" : "HAM\t")
+                         << classify_result.second[0] << "\t" << classify_result.second[1] << "\n";
+                }
+                email->line.set_value(line.str());
+            }
+        });
+
+    // writer: verdicts in input order
+    size_t num_errors = 0;
+    std::future<std::string> line;
+    while (pending.pop(line))
+    {
+        std::string verdict = line.get();
+        num_errors += (verdict.compare(verdict.size() - 6, 6, "ERROR\n") == 0);
+        out << verdict;
+    }
+    out.flush();
+
+    reader.join();
+    for (std::thread& tokenizer : tokenizers)
+        tokenizer.join();
+    to_score.close();
+    for (std::thread& scorer : scorers)
+        scorer.join();
+    paths.tie(tied);
+
+    return num_errors == 0 ? 0 : 2;
+}
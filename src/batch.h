@@ -0,0 +1,20 @@
+#ifndef CLASSIFIER_BATCH_H
+#define CLASSIFIER_BATCH_H
+
+#include <iostream>
+#include "util.h"
+
+// maximum number of emails in flight between the reader and the writer of a batch
+#define BATCH_WINDOW 256
+
+// maximum number of files a batch reads at once; no more than BATCH_WINDOW, since every file
+// read holds a place in the window
+#define BATCH_READ_CHUNK 128
+
+// capacity of the queues between the stages of a batch
+#define BATCH_QUEUE_CAPACITY 64
+
+/**** function prototypes ****/
+int classify_batch(const FilePath&, std::istream&, std::ostream&, char, double, size_t);
+
+#endif //CLASSIFIER_BATCH_H
@@ -1,220 +1,411 @@
+#include <cstdlib>
 #include <iostream>
-#include "util.h"
-
-// no a priori reason for any incoming message to be spam rather than ham,
-// and thus this classifier considers both cases to have equal probabilities
-#define SPAM_PRIOR 0.5
-#define HAM_PRIOR (1 - SPAM_PRIOR)
-
-// number of spam and ham emails encountered in the training dataset
-size_t num_spam_emails = 0;
-size_t num_ham_emails = 0;
-
-/**** function prototypes ****/
-ProbDictPair learn_distributions(const FileListPair&);
-Classification classify_new_email(const FilePath&, const ProbDictPair&,
-    double zeta = 1.0, const ProbPair& prior_by_category = {SPAM_PRIOR, HAM_PRIOR});
-Prob prob_class_intrsct_words(const ProbDict&, const FreqDict&, const Prob&, const EmailClass&);
-ErrorPair evaluate_filter_performance(const DirPath&, const ProbDictPair&,
-    double zeta = 1.0, const ProbPair& prior_by_category = {SPAM_PRIOR, HAM_PRIOR});
-
-/**** functions ****/
-
-/**
- * estimates parameters P(w_i|SPAM) and P(w_i|HAM) for all w_i from the training set
- *
- * @param file_lists_by_category : a two-element array. the first element is a list of
- *  spam files and the second element is a list of ham files
- * @return probabilities_by_category : a two-element array. the first element is a dictionary
- *  whose keys are words and values are smoothed estimates of P(w_i|SPAM); the second element
- *  is a dictionary whose keys are words and values are smoothed estimates of P(w_i|HAM)
- */
-ProbDictPair learn_distributions(const FileListPair& file_lists_by_category)
-{
-    // get word frequency in spam and ham emails in the training dataset [w_i] --> [f_i]
-    FreqDict spam_freq = get_word_freq_in_files(file_lists_by_category[0]);
-    FreqDict ham_freq = get_word_freq_in_files(file_lists_by_category[1]);
-
-    // get number of spam and ham emails in the training dataset
-    num_spam_emails = file_lists_by_category[0].size();
-    num_ham_emails = file_lists_by_category[1].size();
-
-    // create a smoothed estimate of the probabilities P(w_i|SPAM) and P(w_i|HAM)
-    // P(w_i|SPAM/HAM) = ((f_i|SPAM/HAM) + 1) / (#(SPAM/HAM) + 2)
-    ProbDict spam_prob;
-    for (const auto& word : spam_freq)
-        spam_prob[word.first] = (Prob) (word.second + 1)/ (Prob) (num_spam_emails + 2);
-
-    ProbDict ham_prob;
-    for (const auto& word : ham_freq)
-        ham_prob[word.first] = (Prob) (word.second + 1)/ (Prob) (num_ham_emails + 2);
-
-    return {spam_prob, ham_prob};
-}
-
-/**
- * uses naive Bayes classification to classify the email in the given file
- *
- * @param email_path : path of the file to be classified
- * @param probabilities_by_category : output of the learn_distributions() function
- * @param zeta : decision factor; if [ln P(SPAM|Email)] > zeta * [ln P(HAM|Email)],
- *  then the email will be classified as SPAM, and HAM otherwise (empirically optimized).
- * @param prior_by_category : A two-element array as prior probability distribution
- *  for SPAM and HAM email classes
- * @return classification result (std::pair<EmailClass, Prob>) for the given email.
- *  the first element is of type EmailClass (SPAM or HAM) and the second element is a
- *  two-element array as [ln P(SPAM|Email), ln P(HAM|Email)], representing the natural log of
- *  posterior probabilities
- */
-Classification classify_new_email(const FilePath& email_path, const ProbDictPair& probabilities_by_category,
-    double zeta, const ProbPair& prior_by_category)
+#include <stdexcept>
+#include <thread>
+#include "batch.h"
+#include "corpus_cache.h"
+#include "cross_validation.h"
+#include "determinism.h"
+#include "dir_scan.h"
+#include "filter.h"
+#include "memory_report.h"
+#include "metrics.h"
+#include "parameter_search.h"
+#include "plot.h"
+#include "trace.h"
+#include "server.h"
+
+#ifdef WITH_MATPLOTLIB
+#include "matplotlib.h"
+namespace plt = matplotlibcpp;
+#endif
+
+/**** main ****/
+int main(int argc, char* argv[])
 {
-    Classification classify_result;
+    // with SPAMFILTER_METRICS=<file>, counters and phase timings are written to the file on exit
+    enable_metrics_from_environment();
 
-    // get frequency of words in email
-    FreqDict word_freq = get_word_freq_in_file(email_path);
+    // with SPAMFILTER_TRACE=<file>, a Chrome trace of the run is written to the file on exit
+    enable_tracing_from_environment();
+
+    // classifier train <spam_dir> <ham_dir> <model_path> : only train and save the model
+    if (argc == 5 && std::string(argv[1]) == "train")
+    {
+        FileListPair training_files;
+        try
+        {
+            training_files = {get_files_in_folder(argv[2]), get_files_in_folder(argv[3])};
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "cannot train: " << error.what() << std::endl;
+            return 1;
+        }
+        Model model;
+        const char* cache_path = std::getenv(CORPUS_CACHE_ENV);
+        if (cache_path != nullptr && *cache_path != '\0')
+        {
+            // with SPAMFILTER_CORPUS_CACHE=<file>, only emails that changed since the last run are tokenized
+            FileList files = training_files[0];
+            files.insert(files.end(), training_files[1].begin(), training_files[1].end());
+            size_t num_tokenized;
+            CorpusCache cache = open_corpus_cache(cache_path, files, std::thread::hardware_concurrency(), num_tokenized);
+            std::cout << "Tokenized " << num_tokenized << " of " << files.size() << " emails" << std::endl;
+            model = get_model(cache, learn_cached_distributions(cache, training_files));
+        }
+        else
+            model = learn_distributions(training_files, {SPAM_PRIOR, HAM_PRIOR}, std::thread::hardware_concurrency());
+        save_model(argv[4], model);
+        std::cout << "Saved model trained on " << model.num_emails_by_category[0] << " spam and "
+            << model.num_emails_by_category[1]
+            << " ham emails to " << argv[4] << std::endl;
+        return 0;
+    }
 
-    // calculate probability of spam and ham intersect with words in the email
-    Prob spam_intrsct_words = prob_class_intrsct_words(probabilities_by_category[0], word_freq,
-            prior_by_category[0], EmailClass::SPAM);
-    Prob ham_intrsct_words = prob_class_intrsct_words(probabilities_by_category[1], word_freq,
-            prior_by_category[1], EmailClass::HAM);
+    // classifier update <model_path> <add|remove> <spam|ham> <email_path>... : add labeled emails to a
+    // saved model, or remove emails it was trained on, without retraining it
+    if (argc >= 6 && std::string(argv[1]) == "update")
+    {
+        std::string action = argv[3], label = argv[4];
+        if ((action != "add" && action != "remove") || (label != "spam" && label != "ham"))
+        {
+            std::cerr << "usage: classifier update <model_path> <add|remove> <spam|ham> <email_path>..." << std::endl;
+            return 1;
+        }
 
-    // decide email class
-    if (spam_intrsct_words > zeta*ham_intrsct_words)
-        classify_result.first = EmailClass::SPAM;
-    else
-        classify_result.first = EmailClass::HAM;
-
-    // calculate [ln P(SPAM|Email)] and [ln P(HAM|Email)]
-    Prob spam_given_email = spam_intrsct_words - log(exp(spam_intrsct_words) + exp(ham_intrsct_words));
-    Prob ham_given_email = ham_intrsct_words - log(exp(spam_intrsct_words) + exp(ham_intrsct_words));
-
-    classify_result.second = {spam_given_email, ham_given_email};
-    return classify_result;
-}
-
-/**
- * calculates [ln P(Email and Class)]; Email = W = {w_1, ..., w_n}, where w_i is
- * a word in the email; Class corresponds to EmailClass = either SPAM or HAM;
- * Note that, P(Email and Class) = P(Class)*P(Email|Class);
- *
- * @param word_class_prob : dictionary whose keys are email words and values are P(w_i|Class)
- * @param word_email_freq : dictionary whose keys are email words and values are f_(w_i)
- * @param class_prior_prob : prior probability of the email class
- * @return probability of class intersect words of the email, that is, probability of both the
- *  words and class appearing or taking place
- */
-Prob prob_class_intrsct_words(const ProbDict& word_class_prob, const FreqDict& word_email_freq,
-    const Prob& class_prior_prob, const EmailClass& email_class)
-{
-    // P(Class ⋂ Words) = P(Class) * P (Words|Class), where
-    // P(Words|Class) = (\sum w_i)!/(\prod w_i!) * (\prod P(w_i|Class)^f_(w_i))
+        Model model;
+        try
+        {
+            model = load_model(argv[2]);
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "cannot load model: " << error.what() << std::endl;
+            return 1;
+        }
+        EmailClass email_class = (label == "spam") ? EmailClass::SPAM : EmailClass::HAM;
+        for (int i = 5; i < argc; ++i)
+        {
+            try
+            {
+                if (action == "add")
+                    add_email_to_counts(model, get_word_freq_in_file(argv[i]), email_class);
+                else
+                    remove_email_from_counts(model, get_word_freq_in_file(argv[i]), email_class);
+            }
+            catch (const std::invalid_argument& error)
+            {
+                std::cerr << "cannot " << action << " " << argv[i] << ": " << error.what() << std::endl;
+                return 1;
+            }
+        }
+        try
+        {
+            save_model(argv[2], model);
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "cannot save model: " << error.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Model now trained on " << model.num_emails_by_category[0] << " spam and "
+            << model.num_emails_by_category[1] << " ham emails" << std::endl;
+        return 0;
+    }
+
+    // classifier serve <model_path> <socket_path> [zeta] [num_workers] : serve classifications
+    if (argc >= 4 && argc <= 6 && std::string(argv[1]) == "serve")
+    {
+        double zeta = 0.88;
+        size_t num_workers = std::thread::hardware_concurrency();
+        try
+        {
+            zeta = (argc > 4) ? std::stod(argv[4]) : zeta;
+            num_workers = (argc > 5) ? std::stoul(argv[5]) : num_workers;
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "usage: classifier serve <model_path> <socket_path> [zeta] [num_workers]" << std::endl;
+            return 1;
+        }
+        return serve_classifications(argv[2], argv[3], zeta, num_workers);
+    }
 
-    // initialize intersection probability with prior class probability
-    Prob prob_cls_int_wrd = log(class_prior_prob);
+    // classifier scan <dir> [extension] : list the files with the extension (.txt by default) in the
+    // folder and all its subfolders, printing them while the scan goes on; the output can be piped
+    // into classifier batch
+    if ((argc == 3 || argc == 4) && std::string(argv[1]) == "scan")
+    {
+        DirectoryScanner scanner(argv[2], (argc > 3) ? argv[3] : ".txt", true, std::thread::hardware_concurrency());
+
+        std::ios::sync_with_stdio(false);
+        FileListing batch;
+        while (scanner.next_batch(batch))
+            for (size_t i = 0; i < batch.size(); ++i)
+                std::cout << batch.dirs[batch.entries[i].first] << (batch.names.c_str() + batch.entries[i].second) << "\n";
+        std::cout.flush();
+        return scanner.get_num_errors() > 0 ? 2 : 0;
+    }
 
-    // initialize numerator and denominator of the multinomial term
-    long double num = 0.0;
-    long double den = 1.0;
-    Prob prob_word_given_class = 0.0; // ln()
+    // classifier batch <model_path> [zeta] [-0] : classify the emails whose paths are given on
+    // stdin, one per line (or NUL-delimited with -0), and write one verdict line per email
+    if (argc >= 3 && argc <= 5 && std::string(argv[1]) == "batch")
+    {
+        double zeta = 0.88;
+        char delimiter = '\n';
+        try
+        {
+            for (int i = 3; i < argc; ++i)
+            {
+                if (std::string(argv[i]) == "-0")
+                    delimiter = '\0';
+                else
+                    zeta = std::stod(argv[i]);
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "usage: classifier batch <model_path> [zeta] [-0] < paths" << std::endl;
+            return 1;
+        }
+        std::ios::sync_with_stdio(false);
+        return classify_batch(argv[2], std::cin, std::cout, delimiter, zeta, std::thread::hardware_concurrency());
+    }
 
-    // calculate [ln P(Words|Class)] incrementally
-    for (const auto& word : word_email_freq)
+    // classifier check-determinism <spam_dir> <ham_dir> <test_dir> [zeta] : check that training and
+    // classifying at 2, 7 and 64 threads give bit-identical results to a single thread
+    if ((argc == 5 || argc == 6) && std::string(argv[1]) == "check-determinism")
     {
-        // if word not seen before, update probability with a non-zero smoothed estimate
-        if (word_class_prob.find(word.first) == word_class_prob.end())
+        FileListPair training_files;
+        FileList test_files;
+        double zeta = 0.88;
+        try
         {
-            prob_word_given_class += (email_class == EmailClass::SPAM) ?
-                    log((Prob) 1/ (Prob) (num_spam_emails + 2)) : log((Prob) 1/ (Prob) (num_ham_emails + 2));
-            num += 1;
-            den = den; // den += log(1)
+            training_files = {get_files_in_folder(argv[2]), get_files_in_folder(argv[3])};
+            test_files = get_files_in_folder(argv[4]);
+            zeta = (argc > 5) ? std::stod(argv[5]) : zeta;
         }
-        else
+        catch (const std::logic_error&)
         {
-            prob_word_given_class += (word.second)*log(word_class_prob.at(word.first));
-            num += word.second;
-            den += lgamma(word.second + 1.0);
+            std::cerr << "usage: classifier check-determinism <spam_dir> <ham_dir> <test_dir> [zeta]" << std::endl;
+            return 1;
         }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "cannot check determinism: " << error.what() << std::endl;
+            return 1;
+        }
+        return check_determinism(training_files, test_files, {1, 2, 7, 64}, zeta, std::cout) ? 0 : 1;
     }
 
-    // update intersection probability
-    prob_cls_int_wrd += lgamma(num + 1.0) - den;
-    prob_cls_int_wrd += prob_word_given_class;
-
-    return prob_cls_int_wrd;
-}
-
-/**
- * tests filter performance over the given email files
- *
- * @param test_dir : path to directory holding all test emails to be classified
- * @param probabilities_by_category : output of the learn_distributions() function
- * @param zeta : decision factor; if [ln P(SPAM|Email)] > zeta * [ln P(HAM|Email)],
- *  then the email will be classified as SPAM, and HAM otherwise (empirically optimized).
- * @param prior_by_category : A two-element array as prior probability distribution
- *  for SPAM and HAM email classes
- * @return ErrorPair of [Type 1 error, Type 2 error] where type 1 error corresponds to the
- *  fraction of SPAM emails misclassified as HAM, and type 2 error corresponds to the fraction
- *  of HAM emails misclassified as SPAM
- */
-ErrorPair evaluate_filter_performance(const DirPath& test_dir, const ProbDictPair& probabilities_by_category,
-    double zeta, const ProbPair& prior_by_category)
-{
-    // performance evaluation matrix:
-    // [ #(SPAM|SPAM)   ;   #(HAM|SPAM)
-    //   #(SPAM|HAM)    ;   #(HAM|HAM) ], where
-    // #(SPAM|SPAM) is the number of emails which belong to SPAM class and were classified as SPAM
-    // #(HAM|SPAM) is the number of emails which belong to SPAM class and were classified as HAM
-    // #(SPAM|HAM) is the number of emails which belong to HAM class and were classified as SPAM
-    // #(HAM|HAM) is the number of emails which belong to HAM class and were classified as HAM
-    PerformanceMatrix perf_mat = Eigen::Matrix2i::Zero();
-
-    // classify emails from test_dir and measure performance
-    FileList test_files = get_files_in_folder(test_dir);
-    for (const FilePath& email : test_files)
+    // classifier cross-validate <spam_dir> <ham_dir> [num_folds] [zeta] [-s] : estimate the type 1 and 2
+    // errors by k-fold cross-validation over the labeled emails (10 folds by default), with every
+    // fold holding the same share of spam with -s
+    if (argc >= 4 && argc <= 7 && std::string(argv[1]) == "cross-validate")
     {
-        // classify email
-        Classification classify_result = classify_new_email(email, probabilities_by_category,
-                                                            zeta, prior_by_category);
-
-        // populate performance matrix based on if classification result correctly
-        // matches the email's label
-        int true_idx = get_email_label(email);      // SPAM = 0, HAM = 1
-        int classify_idx = classify_result.first;   // SPAM = 0, HAM = 1
-        perf_mat(true_idx, classify_idx) += 1;
+        FileListPair training_files;
+        size_t num_folds = CROSS_VALIDATION_FOLDS;
+        double zeta = 0.88;
+        bool stratified = false;
+        try
+        {
+            training_files = {get_files_in_folder(argv[2]), get_files_in_folder(argv[3])};
+            for (int i = 4, num_values = 0; i < argc; ++i)
+            {
+                if (std::string(argv[i]) == "-s")
+                    stratified = true;
+                else if (num_values++ == 0)
+                    num_folds = std::stoul(argv[i]);
+                else
+                    zeta = std::stod(argv[i]);
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "usage: classifier cross-validate <spam_dir> <ham_dir> [num_folds] [zeta] [-s]" << std::endl;
+            return 1;
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "cannot cross-validate: " << error.what() << std::endl;
+            return 1;
+        }
+
+        size_t num_threads = std::thread::hardware_concurrency();
+        FileList files = training_files[0];
+        files.insert(files.end(), training_files[1].begin(), training_files[1].end());
+        size_t num_tokenized;
+        CorpusCache cache = open_corpus_cache_from_environment(files, num_threads, num_tokenized);
+        std::cout << "Tokenized " << num_tokenized << " of " << files.size() << " emails" << std::endl;
+
+        try
+        {
+            std::vector<size_t> folds = assign_folds(training_files, num_folds, stratified);
+            print_cross_validation(cross_validate(cache, training_files, folds, num_folds, zeta, {SPAM_PRIOR, HAM_PRIOR},
+                num_threads), std::cout);
+        }
+        catch (const std::invalid_argument& error)
+        {
+            std::cerr << "cannot cross-validate: " << error.what() << std::endl;
+            return 1;
+        }
+        return 0;
     }
 
-    // get total number of spam and ham emails in the testing dataset
-    int total_spam = perf_mat(0,0) + perf_mat(0,1);
-    int total_ham = perf_mat(1,0) + perf_mat(1,1);
+    // classifier search <spam_dir> <ham_dir> [-k num_folds] [-a smoothing,...] [-p spam_prior,...] [-z zeta,...]
+    // [-o results.csv] : evaluate every combination of the values by stratified cross-validation, and print the best
+    if (argc >= 4 && std::string(argv[1]) == "search")
+    {
+        FileListPair training_files;
+        size_t num_folds = CROSS_VALIDATION_FOLDS;
+        std::vector<Prob> smoothings = SEARCH_DEFAULT_SMOOTHINGS;
+        std::vector<Prob> spam_priors = SEARCH_DEFAULT_SPAM_PRIORS;
+        std::vector<double> zetas = SEARCH_DEFAULT_ZETAS;
+        FilePath results_path;
+        try
+        {
+            training_files = {get_files_in_folder(argv[2]), get_files_in_folder(argv[3])};
+            for (int i = 4; i + 1 < argc; i += 2)
+            {
+                std::string option = argv[i], values = argv[i + 1];
+                std::vector<std::string> list;
+                for (size_t begin = 0, end; begin <= values.size(); begin = end + 1)
+                {
+                    end = std::min(values.find(',', begin), values.size());
+                    list.push_back(values.substr(begin, end - begin));
+                }
+
+                if (option == "-k")
+                    num_folds = std::stoul(values);
+                else if (option == "-a" || option == "-p")
+                {
+                    std::vector<Prob>& parsed = (option == "-a") ? smoothings : spam_priors;
+                    parsed.clear();
+                    for (const std::string& value : list)
+                        parsed.push_back(std::stold(value));
+                }
+                else if (option == "-z")
+                {
+                    zetas.clear();
+                    for (const std::string& value : list)
+                        zetas.push_back(std::stod(value));
+                }
+                else if (option == "-o")
+                    results_path = values;
+                else
+                    throw std::invalid_argument("unknown option " + option);
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "usage: classifier search <spam_dir> <ham_dir> [-k num_folds] [-a smoothing,...]"
+                << " [-p spam_prior,...] [-z zeta,...] [-o results.csv]" << std::endl;
+            return 1;
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "cannot search: " << error.what() << std::endl;
+            return 1;
+        }
+
+        size_t num_threads = std::thread::hardware_concurrency();
+        FileList files = training_files[0];
+        files.insert(files.end(), training_files[1].begin(), training_files[1].end());
+        size_t num_tokenized;
+        CorpusCache cache = open_corpus_cache_from_environment(files, num_threads, num_tokenized);
+        std::cout << "Tokenized " << num_tokenized << " of " << files.size() << " emails" << std::endl;
 
-    // print result
-    std::cout << "Correctly classified " << perf_mat.diagonal()(0) << " out of "
-        << total_spam << " spam emails, and " << perf_mat.diagonal()(1) << " out of "
-        << total_ham << " ham emails" << std::endl;
+        std::vector<SearchResult> results;
+        try
+        {
+            std::vector<size_t> folds = assign_folds(training_files, num_folds, true);
+            results = search_parameters(cache, training_files, folds, num_folds, smoothings, spam_priors, zetas, num_threads);
+        }
+        catch (const std::invalid_argument& error)
+        {
+            std::cerr << "cannot search: " << error.what() << std::endl;
+            return 1;
+        }
+        if (!results_path.empty())
+            save_search_results(results_path, results);
+        sort_search_results(results);
+        print_search_results(results, SEARCH_NUM_BEST, std::cout);
+        return 0;
+    }
 
-    // return array of type 1 and type 2 errors
-    double type_1_error = (double) perf_mat(0,1)/ (double) total_spam;
-    double type_2_error = (double) perf_mat(1,0)/ (double) total_ham;
-    return {type_1_error, type_2_error};
-}
+    // classifier memory <spam_dir> <ham_dir> <test_dir> [vocabulary_size]... : report where memory goes
+    // when training on the emails and classifying the test emails, and project the model's memory
+    // to the given vocabulary sizes
+    if (argc >= 5 && std::string(argv[1]) == "memory")
+    {
+        FileListPair training_files;
+        FileList test_files;
+        std::vector<size_t> vocabulary_sizes = MEMORY_DEFAULT_PROJECTIONS;
+        if (argc > 5)
+            vocabulary_sizes.clear();
+        try
+        {
+            training_files = {get_files_in_folder(argv[2]), get_files_in_folder(argv[3])};
+            test_files = get_files_in_folder(argv[4]);
+            for (int i = 5; i < argc; ++i)
+                vocabulary_sizes.push_back(std::stoul(argv[i]));
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "usage: classifier memory <spam_dir> <ham_dir> <test_dir> [vocabulary_size]..." << std::endl;
+            return 1;
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "cannot report memory: " << error.what() << std::endl;
+            return 1;
+        }
+        report_memory(training_files, test_files, vocabulary_sizes, std::cout);
+        return 0;
+    }
 
-/**** main ****/
-int main()
-{
     // folders for training and testing
     DirPath spam_dir = "../data/spam/";
     DirPath ham_dir = "../data/ham/";
     DirPath test_dir = "../data/testing";
 
-    // file lists for training
-    FileList spam_files = get_files_in_folder(spam_dir);
-    FileList ham_files = get_files_in_folder(ham_dir);
+    // file lists for training and testing
+    FileList spam_files, ham_files, test_files;
+    try
+    {
+        spam_files = get_files_in_folder(spam_dir);
+        ham_files = get_files_in_folder(ham_dir);
+        test_files = get_files_in_folder(test_dir);
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << "cannot read emails: " << error.what() << std::endl;
+        return 1;
+    }
     FileListPair training_files = {spam_files, ham_files};
 
-    // learn distributions from training data
-    ProbDictPair probabilities_by_category = learn_distributions(training_files);
+    // learn distributions from training data; with SPAMFILTER_CORPUS_CACHE=<file>, from the words of
+    // the training and test emails cached by earlier runs, and tokenizing only those that changed
+    size_t num_threads = std::thread::hardware_concurrency();
+    const char* cache_path = std::getenv(CORPUS_CACHE_ENV);
+    bool use_cache = cache_path != nullptr && *cache_path != '\0';
+    CorpusCache cache;
+    CachedModel cached_model;
+    Model model;
+    if (use_cache)
+    {
+        FileList files = spam_files;
+        files.insert(files.end(), ham_files.begin(), ham_files.end());
+        files.insert(files.end(), test_files.begin(), test_files.end());
+        size_t num_tokenized;
+        cache = open_corpus_cache(cache_path, files, num_threads, num_tokenized);
+        std::cout << "Tokenized " << num_tokenized << " of " << files.size() << " emails" << std::endl;
+        cached_model = learn_cached_distributions(cache, training_files);
+        model = get_model(cache, cached_model);
+    }
+    else
+        model = learn_distributions(training_files, {SPAM_PRIOR, HAM_PRIOR}, num_threads);
 
     // classify test emails and evaluate performance for \zeta \in [0.0, 1.0]
     std::vector<double> type_1_error;
@@ -225,14 +416,23 @@ int main()
 
     while (zeta.back() <= 1.0)
     {
-        classify_error = evaluate_filter_performance(test_dir, probabilities_by_category, zeta.back());
+        if (use_cache)
+            classify_error = evaluate_cached_performance(cache, test_files, cached_model, zeta.back(), num_threads);
+        else
+            classify_error = evaluate_filter_performance(test_dir, model, zeta.back(), ScoringMode::FULL_SCAN, num_threads);
         type_1_error.push_back(classify_error[0]);
         type_2_error.push_back(classify_error[1]);
         zeta.push_back(zeta.back() + dz);
     }
 
-    // plot and save results
+    // save results, as data and as a plot
     zeta.pop_back();
+    save_curves_csv("../error_tradeoff_curve.csv", zeta, {type_1_error, type_2_error},
+                    "zeta", {"Type 1 Error", "Type 2 Error"});
+    save_curves_svg("../error_tradeoff_curve.svg", zeta, {type_1_error, type_2_error},
+                    "Error Trade-off Curve", {"Type 1 Error", "Type 2 Error"}, "zeta", "Error");
+
+#ifdef WITH_MATPLOTLIB
     plt::plot(zeta, type_1_error,  {{"label", "Type 1 Error"}});
     plt::plot(zeta, type_2_error, {{"label", "Type 2 Error"}});
     plt::xlabel("zeta");
@@ -241,9 +441,25 @@ int main()
     plt::legend();
     plt::save("../error_tradeoff_curve.png");
     plt::show(); // blocking display
+#endif
 
     // trade-off curves meet at the optimal zeta* ≈ 0.88.
     std::cout << "------- OPTIMAL ZETA -------" << std::endl;
-    evaluate_filter_performance(test_dir, probabilities_by_category, 0.88);
+    if (use_cache)
+        evaluate_cached_performance(cache, test_files, cached_model, 0.88, num_threads);
+    else
+        evaluate_filter_performance(test_dir, model, 0.88, ScoringMode::FULL_SCAN, num_threads);
+
+    // same decision factor, scoring only the most significant words of every email
+    std::cout << "------- " << NUM_SIGNIFICANT_WORDS << " MOST SIGNIFICANT WORDS -------" << std::endl;
+    evaluate_filter_performance(test_dir, model, 0.88, ScoringMode::SIGNIFICANT_WORDS, num_threads);
+
+    // same decision factor, reading every email only until its classification is certain
+    std::cout << "------- EARLY EXIT -------" << std::endl;
+    evaluate_filter_performance(test_dir, model, 0.88, ScoringMode::EARLY_EXIT, num_threads);
+
+    // same decision factor, reading every email in chunks up to a bounded size
+    std::cout << "------- STREAMING -------" << std::endl;
+    evaluate_filter_performance(test_dir, model, 0.88, ScoringMode::STREAMING, num_threads);
     return 0;
 }
\ No newline at end of file
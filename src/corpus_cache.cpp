@@ -0,0 +1,618 @@
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include "corpus_cache.h"
+#include "ingest.h"
+#include "scheduler.h"
+#include "trace.h"
+
+// FNV-1a 64-bit offset basis and prime
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/**** function prototypes ****/
+void get_file_status(const FilePath&, CachedEmail&);
+void write_uint(std::ostream&, uint64_t);
+bool read_uint(std::istream&, uint64_t&);
+void write_string(std::ostream&, const std::string&);
+bool read_string(std::istream&, std::string&, uint64_t);
+uint64_t get_remaining_bytes(std::istream&, uint64_t);
+
+/**** functions ****/
+
+/**
+ * loads emails cached by save_corpus_cache(). no count read from the file is trusted beyond what
+ * the rest of the file could hold, so that a damaged file is never taken for a huge one
+ *
+ * @param cache_path : path of the cache file
+ * @return the cached emails; an empty cache if the file does not exist, was written by another
+ *  version, is damaged, or does not fit in memory, so that every email is then tokenized again
+ */
+CorpusCache load_corpus_cache(const FilePath& cache_path)
+{
+    TraceSpan span("load_corpus_cache");
+    CorpusCache cache;
+    std::ifstream file(cache_path, std::ios::binary | std::ios::ate);
+    uint64_t file_size = file ? (uint64_t) file.tellg() : 0;
+    file.seekg(0, std::ios::beg);
+    std::string header;
+    if (!std::getline(file, header) || header != CORPUS_CACHE_HEADER)
+        return CorpusCache();
+
+    try
+    {
+        // every word takes its length, and every email its path, size, modification time, inode,
+        // hash and number of words, at least
+        uint64_t num_words, num_emails;
+        if (!read_uint(file, num_words) || num_words > UINT32_MAX
+            || num_words > get_remaining_bytes(file, file_size) / sizeof(uint64_t))
+            return CorpusCache();
+        cache.vocabulary.resize(num_words);
+        cache.word_ids.reserve(num_words);
+        for (uint32_t id = 0; id < num_words; ++id)
+        {
+            if (!read_string(file, cache.vocabulary[id], file_size))
+                return CorpusCache();
+            cache.word_ids.emplace(cache.vocabulary[id], id);
+        }
+
+        if (!read_uint(file, num_emails) || num_emails > get_remaining_bytes(file, file_size) / (6*sizeof(uint64_t)))
+            return CorpusCache();
+        cache.emails.reserve(num_emails);
+        for (uint64_t i = 0; i < num_emails; ++i)
+        {
+            FilePath email_path;
+            CachedEmail email;
+            uint64_t mtime_ns, num_tokens;
+            if (!read_string(file, email_path, file_size) || !read_uint(file, email.size) || !read_uint(file, mtime_ns)
+                || !read_uint(file, email.inode) || !read_uint(file, email.hash) || !read_uint(file, num_tokens)
+                || num_tokens > num_words || num_tokens > get_remaining_bytes(file, file_size) / sizeof(TokenCount))
+                return CorpusCache();
+            email.mtime_ns = (int64_t) mtime_ns;
+
+            email.token_counts.resize(num_tokens);
+            file.read((char*) email.token_counts.data(), (std::streamsize) (num_tokens * sizeof(TokenCount)));
+            if (!file)
+                return CorpusCache();
+            for (const TokenCount& token : email.token_counts)
+                if (token.first >= num_words)
+                    return CorpusCache();
+            cache.emails[email_path] = std::move(email);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return CorpusCache();
+    }
+
+    return cache;
+}
+
+/**
+ * saves cached emails, replacing the file at once so that a run never reads half of it. the file
+ * holds a header line, the vocabulary, and then, for every email, its path, size, modification
+ * time, inode and hash followed by its (word id, frequency) pairs, all in the byte order of the
+ * machine: it is meant to stay on the machine that wrote it
+ *
+ * @param cache_path : path of the cache file
+ * @param cache : emails to be saved
+ * @return whether the cache was saved
+ */
+bool save_corpus_cache(const FilePath& cache_path, const CorpusCache& cache)
+{
+    TraceSpan span("save_corpus_cache");
+    FilePath temp_file = cache_path + ".tmp";
+    {
+        std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+        file << CORPUS_CACHE_HEADER << "\n";
+
+        write_uint(file, cache.vocabulary.size());
+        for (const std::string& word : cache.vocabulary)
+            write_string(file, word);
+
+        write_uint(file, cache.emails.size());
+        for (const auto& email : cache.emails)
+        {
+            write_string(file, email.first);
+            write_uint(file, email.second.size);
+            write_uint(file, (uint64_t) email.second.mtime_ns);
+            write_uint(file, email.second.inode);
+            write_uint(file, email.second.hash);
+            write_uint(file, email.second.token_counts.size());
+            file.write((const char*) email.second.token_counts.data(),
+                       (std::streamsize) (email.second.token_counts.size() * sizeof(TokenCount)));
+        }
+        if (!file)
+            return false;
+    }
+    return std::rename(temp_file.c_str(), cache_path.c_str()) == 0;
+}
+
+/**
+ * brings the cache up to date with email files: a file whose size, modification time and inode
+ * did not change is taken as it was cached; otherwise it is read, and only tokenized again if
+ * its contents changed, which its hash tells
+ *
+ * @param cache : the cache to be updated
+ * @param files : paths of the emails
+ * @param num_threads : number of threads tokenizing emails; more than one read emails many at
+ *  once and run on a TaskScheduler, which splits large emails into byte ranges
+ * @return number of emails tokenized
+ */
+size_t update_corpus_cache(CorpusCache& cache, const FileList& files, size_t num_threads)
+{
+    TraceSpan span("update_corpus_cache");
+
+    // files never cached, or changed since; a file listed twice is only read once
+    FileList changed_files;
+    std::vector<CachedEmail> changed_emails;
+    std::unordered_map<FilePath, size_t> changed_indices;
+    for (const FilePath& file : files)
+    {
+        CachedEmail status;
+        get_file_status(file, status);
+        auto it = cache.emails.find(file);
+        if (it != cache.emails.end() && status.mtime_ns >= 0 && it->second.size == status.size
+            && it->second.mtime_ns == status.mtime_ns && it->second.inode == status.inode)
+            continue;
+        if (changed_indices.emplace(file, changed_files.size()).second)
+        {
+            changed_files.push_back(file);
+            changed_emails.push_back(status);
+        }
+    }
+
+    // hash every changed file, and count the words of those whose contents changed too; this only
+    // reads the cache, while every task writes the entries of its own file
+    std::vector<FreqDict> word_freqs(changed_files.size());
+    std::vector<char> unchanged(changed_files.size(), 0);
+    auto hash_email = [&](size_t i, const std::string& contents)
+    {
+        changed_emails[i].hash = get_content_hash(contents.data(), contents.size());
+        auto it = cache.emails.find(changed_files[i]);
+        unchanged[i] = it != cache.emails.end() && it->second.hash == changed_emails[i].hash;
+        return (bool) unchanged[i];
+    };
+
+    if (num_threads > 1)
+    {
+        TaskScheduler scheduler(num_threads);
+        read_files(changed_files, [&](size_t i, std::string& contents, bool)
+        {
+            scheduler.wait_until_below(SCHEDULER_MAX_UNFINISHED);
+            auto shared_contents = std::make_shared<const std::string>(std::move(contents));
+            scheduler.submit([&, i, shared_contents]()
+            {
+                if (!hash_email(i, *shared_contents))
+                    submit_word_freq_in_buffer(scheduler, shared_contents, [&, i](FreqDict& word_freq)
+                    {
+                        word_freqs[i] = std::move(word_freq);
+                    });
+            });
+        }, num_threads);
+        scheduler.wait();
+    }
+    else
+    {
+        std::string contents;
+        for (size_t i = 0; i < changed_files.size(); ++i)
+        {
+            if (!read_file(changed_files[i], contents))
+                contents.clear();
+            if (!hash_email(i, contents))
+                word_freqs[i] = get_word_freq_in_buffer(contents.data(), contents.size());
+        }
+    }
+
+    // words get their ids in a single thread, in the order of the files, so that the vocabulary
+    // does not depend on the number of threads
+    size_t num_tokenized = 0;
+    for (size_t i = 0; i < changed_files.size(); ++i)
+    {
+        CachedEmail& email = cache.emails[changed_files[i]];
+        if (!unchanged[i])
+        {
+            changed_emails[i].token_counts.reserve(word_freqs[i].size());
+            for (const FreqDict::value_type* word : get_sorted_words(word_freqs[i]))
+                changed_emails[i].token_counts.emplace_back(get_word_id(cache, word->first), (uint32_t) word->second);
+            ++num_tokenized;
+        }
+        else
+            changed_emails[i].token_counts = std::move(email.token_counts);
+        email = std::move(changed_emails[i]);
+    }
+
+    return num_tokenized;
+}
+
+/**
+ * drops the emails whose files no longer exist, and the words no email contains anymore; words
+ * keep their order in the vocabulary, but not their ids
+ *
+ * @param cache : the cache to be compacted
+ * @return whether anything was dropped
+ */
+bool compact_corpus_cache(CorpusCache& cache)
+{
+    size_t num_emails = cache.emails.size();
+    for (auto it = cache.emails.begin(); it != cache.emails.end();)
+    {
+        struct stat status;
+        if (stat(it->first.c_str(), &status) != 0)
+            it = cache.emails.erase(it);
+        else
+            ++it;
+    }
+
+    std::vector<char> used(cache.vocabulary.size(), 0);
+    for (const auto& email : cache.emails)
+        for (const TokenCount& token : email.second.token_counts)
+            used[token.first] = 1;
+
+    std::vector<uint32_t> new_ids(cache.vocabulary.size());
+    uint32_t num_words = 0;
+    for (uint32_t id = 0; id < cache.vocabulary.size(); ++id)
+    {
+        if (!used[id])
+            continue;
+        new_ids[id] = num_words;
+        if (num_words != id)
+            cache.vocabulary[num_words] = std::move(cache.vocabulary[id]);
+        ++num_words;
+    }
+    if (num_words == used.size() && cache.emails.size() == num_emails)
+        return false;
+
+    cache.vocabulary.resize(num_words);
+    cache.word_ids.clear();
+    for (uint32_t id = 0; id < num_words; ++id)
+        cache.word_ids.emplace(cache.vocabulary[id], id);
+    for (auto& email : cache.emails)
+        for (TokenCount& token : email.second.token_counts)
+            token.first = new_ids[token.first];
+    return true;
+}
+
+/**
+ * loads a cache, brings it up to date with email files, and saves it back if anything changed
+ *
+ * @param cache_path : path of the cache file
+ * @param files : paths of the emails
+ * @param num_threads : number of threads tokenizing emails; see update_corpus_cache()
+ * @param num_tokenized : set to the number of emails tokenized
+ * @return the cache, holding every email of files
+ */
+CorpusCache open_corpus_cache(const FilePath& cache_path, const FileList& files, size_t num_threads,
+    size_t& num_tokenized)
+{
+    CorpusCache cache = load_corpus_cache(cache_path);
+    num_tokenized = update_corpus_cache(cache, files, num_threads);
+    bool compacted = compact_corpus_cache(cache);
+    if (num_tokenized > 0 || compacted)
+        save_corpus_cache(cache_path, cache);
+    return cache;
+}
+
+/**
+ * tokenizes emails once for a run: through the cache file named by CORPUS_CACHE_ENV if it is set,
+ * and otherwise into a cache kept in memory only
+ *
+ * @param files : paths of the emails
+ * @param num_threads : number of threads tokenizing emails; see update_corpus_cache()
+ * @param num_tokenized : set to the number of emails tokenized
+ * @return the cache, holding every email of files
+ */
+CorpusCache open_corpus_cache_from_environment(const FileList& files, size_t num_threads, size_t& num_tokenized)
+{
+    const char* cache_path = std::getenv(CORPUS_CACHE_ENV);
+    if (cache_path != nullptr && *cache_path != '\0')
+        return open_corpus_cache(cache_path, files, num_threads, num_tokenized);
+
+    CorpusCache cache;
+    num_tokenized = update_corpus_cache(cache, files, num_threads);
+    return cache;
+}
+
+/**
+ * gets what tells whether a file changed: its size, modification time and inode
+ *
+ * @param file_path : path of the file
+ * @param email : its size, mtime_ns and inode are set; mtime_ns is -1 if the file cannot be read
+ */
+void get_file_status(const FilePath& file_path, CachedEmail& email)
+{
+    struct stat status;
+    if (stat(file_path.c_str(), &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        email.mtime_ns = -1;
+        return;
+    }
+    email.size = (uint64_t) status.st_size;
+    email.mtime_ns = (int64_t) status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+    email.inode = (uint64_t) status.st_ino;
+}
+
+/**
+ * hashes the contents of a file with FNV-1a
+ *
+ * @param data : the contents
+ * @param size : their size
+ * @return 64-bit hash
+ */
+uint64_t get_content_hash(const char* data, size_t size)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ (unsigned char) data[i]) * FNV_PRIME;
+    return hash;
+}
+
+/**
+ * gets the id of a word, adding the word to the vocabulary if it is not there yet
+ *
+ * @param cache : cache whose vocabulary holds the word
+ * @param word : the word
+ * @return its id
+ */
+uint32_t get_word_id(CorpusCache& cache, const std::string& word)
+{
+    auto it = cache.word_ids.emplace(word, (uint32_t) cache.vocabulary.size());
+    if (it.second)
+        cache.vocabulary.push_back(word);
+    return it.first->second;
+}
+
+/**
+ * gets the words of a cached email
+ *
+ * @param cache : cache holding the email; see update_corpus_cache()
+ * @param email_path : path of the email
+ * @return (word id, frequency) pairs of the email, sorted by word
+ */
+const TokenCounts& get_cached_email(const CorpusCache& cache, const FilePath& email_path)
+{
+    auto it = cache.emails.find(email_path);
+    if (it == cache.emails.end())
+        throw std::invalid_argument("email not in the corpus cache: " + email_path);
+    return it->second.token_counts;
+}
+
+/**
+ * learns a model from cached emails, as learn_distributions() does from their files
+ *
+ * @param cache : cache holding every email of file_lists_by_category
+ * @param file_lists_by_category : a two-element array of the spam and ham files
+ * @param prior_by_category : prior probabilities of SPAM and HAM
+ * @return counts of the model by word id of the cache's vocabulary
+ */
+CachedModel learn_cached_distributions(const CorpusCache& cache, const FileListPair& file_lists_by_category,
+    const ProbPair& prior_by_category)
+{
+    TraceSpan span("learn_distributions");
+    CachedModel model;
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        model.freq_by_category[c].assign(cache.vocabulary.size(), 0);
+        for (const FilePath& file : file_lists_by_category[c])
+            for (const TokenCount& token : get_cached_email(cache, file))
+                model.freq_by_category[c][token.first] += token.second;
+        model.num_emails_by_category[c] = file_lists_by_category[c].size();
+    }
+
+    model.prior_by_category = prior_by_category;
+    return model;
+}
+
+/**
+ * indexes the counts of a model by word id, to score cached emails with it; words of the model
+ * missing from the cache's vocabulary are left out, since no cached email contains them
+ *
+ * @param cache : cache whose vocabulary the counts are indexed by
+ * @param model : output of the learn_distributions() or load_model() functions
+ * @return the same model, indexed by word id
+ */
+CachedModel get_cached_model(const CorpusCache& cache, const Model& model)
+{
+    CachedModel cached_model;
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        cached_model.freq_by_category[c].assign(cache.vocabulary.size(), 0);
+        for (uint32_t id = 0; id < cache.vocabulary.size(); ++id)
+        {
+            auto it = model.freq_by_category[c].find(cache.vocabulary[id]);
+            if (it != model.freq_by_category[c].end())
+                cached_model.freq_by_category[c][id] = it->second;
+        }
+    }
+
+    cached_model.num_emails_by_category = model.num_emails_by_category;
+    cached_model.prior_by_category = model.prior_by_category;
+    return cached_model;
+}
+
+/**
+ * turns counts indexed by word id back into a model, for example to save it
+ *
+ * @param cache : cache whose vocabulary the counts are indexed by
+ * @param cached_model : output of the learn_cached_distributions() function
+ * @return the same model, keyed by word
+ */
+Model get_model(const CorpusCache& cache, const CachedModel& cached_model)
+{
+    Model model;
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+        for (uint32_t id = 0; id < cached_model.freq_by_category[c].size(); ++id)
+            if (cached_model.freq_by_category[c][id] > 0)
+                model.freq_by_category[c][cache.vocabulary[id]] = cached_model.freq_by_category[c][id];
+
+    model.num_emails_by_category = cached_model.num_emails_by_category;
+    model.prior_by_category = cached_model.prior_by_category;
+    return model;
+}
+
+/**
+ * calculates [ln P(Email and Class)] of a cached email, with the same terms, summed in the same
+ * order, as prob_class_intrsct_words(); a word id is seen in a class if its frequency is not 0
+ *
+ * @param model : counts by word id, from learn_cached_distributions() or get_cached_model()
+ * @param token_counts : (word id, frequency) pairs of the email, sorted by word
+ * @param email_class : the class (SPAM or HAM)
+ * @return [ln P(Email and Class)]
+ */
+Prob prob_class_intrsct_tokens(const CachedModel& model, const TokenCounts& token_counts, const EmailClass& email_class)
+{
+    const IdFreqs& class_freq_by_id = model.freq_by_category[email_class];
+    Prob prob_cls_int_wrd = log(model.prior_by_category[email_class]);
+
+    long double num = 0.0;
+    std::vector<Prob> den_terms;
+    std::vector<Prob> prob_word_given_class_terms;
+    Prob num_class_emails = (Prob) (model.num_emails_by_category[email_class] + 2);
+
+    for (const TokenCount& token : token_counts)
+    {
+        // ids added to the vocabulary after the model was built are unseen
+        size_t class_freq = (token.first < class_freq_by_id.size()) ? class_freq_by_id[token.first] : 0;
+        if (class_freq == 0)
+        {
+            prob_word_given_class_terms.push_back(log((Prob) 1/ num_class_emails));
+            num += 1;
+        }
+        else
+        {
+            prob_word_given_class_terms.push_back((token.second)*log((Prob) (class_freq + 1)/ num_class_emails));
+            num += token.second;
+            den_terms.push_back(lgamma(token.second + 1.0));
+        }
+    }
+    long double den = 1.0 + get_pairwise_sum(den_terms.data(), den_terms.size());
+    Prob prob_word_given_class = get_pairwise_sum(prob_word_given_class_terms.data(), prob_word_given_class_terms.size());
+
+    prob_cls_int_wrd += lgamma(num + 1.0) - den;
+    prob_cls_int_wrd += prob_word_given_class;
+    return prob_cls_int_wrd;
+}
+
+/**
+ * classifies a cached email; see classify_word_freq()
+ *
+ * @param token_counts : (word id, frequency) pairs of the email, sorted by word
+ * @param model : counts by word id, from learn_cached_distributions() or get_cached_model()
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_token_counts(const TokenCounts& token_counts, const CachedModel& model, double zeta)
+{
+    Prob spam_intrsct_words = prob_class_intrsct_tokens(model, token_counts, EmailClass::SPAM);
+    Prob ham_intrsct_words = prob_class_intrsct_tokens(model, token_counts, EmailClass::HAM);
+
+    return classify_scores({spam_intrsct_words, ham_intrsct_words}, zeta);
+}
+
+/**
+ * classifies cached emails, each independently of the others; see classify_files()
+ *
+ * @param cache : cache holding every email of files
+ * @param files : paths of the emails to be classified
+ * @param model : counts by word id, from learn_cached_distributions() or get_cached_model()
+ * @param zeta : decision factor; see classify_new_email()
+ * @param num_threads : number of threads classifying emails; more than one run on a TaskScheduler
+ * @return classification of each email, in the order of files
+ */
+std::vector<Classification> classify_cached_emails(const CorpusCache& cache, const FileList& files,
+    const CachedModel& model, double zeta, size_t num_threads)
+{
+    std::vector<Classification> classify_results(files.size());
+    std::vector<const TokenCounts*> emails;
+    for (const FilePath& file : files)
+        emails.push_back(&get_cached_email(cache, file));
+
+    if (num_threads > 1)
+    {
+        TaskScheduler scheduler(num_threads);
+        for (size_t i = 0; i < files.size(); ++i)
+            scheduler.submit([&, i]() { classify_results[i] = classify_token_counts(*emails[i], model, zeta); });
+        scheduler.wait();
+    }
+    else
+    {
+        for (size_t i = 0; i < files.size(); ++i)
+            classify_results[i] = classify_token_counts(*emails[i], model, zeta);
+    }
+
+    return classify_results;
+}
+
+/**
+ * tests filter performance over cached emails, as evaluate_filter_performance() does in the
+ * FULL_SCAN mode, with the same results
+ *
+ * @param cache : cache holding every email of test_files
+ * @param test_files : paths of the emails to be classified
+ * @param model : counts by word id, from learn_cached_distributions() or get_cached_model()
+ * @param zeta : decision factor; see evaluate_filter_performance()
+ * @param num_threads : number of threads classifying emails
+ * @return ErrorPair of [Type 1 error, Type 2 error]; see evaluate_filter_performance()
+ */
+ErrorPair evaluate_cached_performance(const CorpusCache& cache, const FileList& test_files, const CachedModel& model,
+    double zeta, size_t num_threads)
+{
+    PerformanceMatrix perf_mat = get_performance_matrix(test_files,
+        classify_cached_emails(cache, test_files, model, zeta, num_threads));
+    print_performance(perf_mat);
+    return get_errors(perf_mat);
+}
+
+/**
+ * writes an unsigned integer as 8 bytes, in the byte order of the machine
+ */
+void write_uint(std::ostream& file, uint64_t value)
+{
+    file.write((const char*) &value, sizeof(value));
+}
+
+/**
+ * reads an unsigned integer written by write_uint()
+ *
+ * @return whether it could be read
+ */
+bool read_uint(std::istream& file, uint64_t& value)
+{
+    return (bool) file.read((char*) &value, sizeof(value));
+}
+
+/**
+ * writes a string as its length followed by its bytes
+ */
+void write_string(std::ostream& file, const std::string& value)
+{
+    write_uint(file, value.size());
+    file.write(value.data(), (std::streamsize) value.size());
+}
+
+/**
+ * reads a string written by write_string()
+ *
+ * @param max_size : size of the file; no longer string could have been written to it
+ * @return whether it could be read
+ */
+bool read_string(std::istream& file, std::string& value, uint64_t max_size)
+{
+    uint64_t size;
+    if (!read_uint(file, size) || size > max_size)
+        return false;
+    value.resize(size);
+    return (bool) file.read(&value[0], (std::streamsize) size);
+}
+
+/**
+ * @param file_size : size of the file being read
+ * @return number of bytes of the file left to be read
+ */
+uint64_t get_remaining_bytes(std::istream& file, uint64_t file_size)
+{
+    std::streamoff offset = file.tellg();
+    return (offset < 0 || (uint64_t) offset > file_size) ? 0 : file_size - (uint64_t) offset;
+}
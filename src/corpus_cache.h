@@ -0,0 +1,69 @@
+#ifndef CLASSIFIER_CORPUS_CACHE_H
+#define CLASSIFIER_CORPUS_CACHE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "filter.h"
+
+// environment variable naming the file the words of the emails classifier trains on and tests
+// are cached in; when set, an email is only read and tokenized again once it changed
+#define CORPUS_CACHE_ENV "SPAMFILTER_CORPUS_CACHE"
+
+// first line of every cache file written by save_corpus_cache()
+#define CORPUS_CACHE_HEADER "bayesian-spam-filter corpus cache v1"
+
+/**** type definitions ****/
+typedef std::pair<uint32_t, uint32_t> TokenCount;           // id of a word in a vocabulary, and f_(w_i) in an email
+typedef std::vector<TokenCount> TokenCounts;                // words of an email, sorted by word rather than by id
+typedef std::vector<size_t> IdFreqs;                        // a frequency for every word id of a vocabulary
+
+// words of an email, and what tells whether its file changed since they were counted
+struct CachedEmail
+{
+    uint64_t size = 0;
+    int64_t mtime_ns = -1;                                  // -1 if the file could not be read
+    uint64_t inode = 0;
+    uint64_t hash = 0;                                      // FNV-1a hash of the contents
+    TokenCounts token_counts;
+};
+
+// emails tokenized once, as lists of ids into a vocabulary they all share
+struct CorpusCache
+{
+    WordList vocabulary;                                    // word of every id
+    std::unordered_map<std::string, uint32_t> word_ids;
+    std::unordered_map<FilePath, CachedEmail> emails;       // by path, as given to update_corpus_cache()
+};
+
+// counts of a model indexed by the word ids of a corpus cache, so that emails of the cache are
+// scored without hashing a single word; same as Model otherwise
+struct CachedModel
+{
+    std::array<IdFreqs, 2> freq_by_category;                // f_i of every word id in the spam and ham emails
+    CountPair num_emails_by_category = {0, 0};              // number of spam and ham emails
+    ProbPair prior_by_category = {0.5, 0.5};                // prior probabilities of SPAM and HAM
+};
+
+/**** function prototypes ****/
+CorpusCache load_corpus_cache(const FilePath&);
+bool save_corpus_cache(const FilePath&, const CorpusCache&);
+size_t update_corpus_cache(CorpusCache&, const FileList&, size_t num_threads = 1);
+bool compact_corpus_cache(CorpusCache&);
+CorpusCache open_corpus_cache(const FilePath&, const FileList&, size_t, size_t&);
+CorpusCache open_corpus_cache_from_environment(const FileList&, size_t, size_t&);
+uint64_t get_content_hash(const char*, size_t);
+uint32_t get_word_id(CorpusCache&, const std::string&);
+const TokenCounts& get_cached_email(const CorpusCache&, const FilePath&);
+CachedModel learn_cached_distributions(const CorpusCache&, const FileListPair&,
+    const ProbPair& prior_by_category = {SPAM_PRIOR, HAM_PRIOR});
+CachedModel get_cached_model(const CorpusCache&, const Model&);
+Model get_model(const CorpusCache&, const CachedModel&);
+Prob prob_class_intrsct_tokens(const CachedModel&, const TokenCounts&, const EmailClass&);
+Classification classify_token_counts(const TokenCounts&, const CachedModel&, double);
+std::vector<Classification> classify_cached_emails(const CorpusCache&, const FileList&, const CachedModel&,
+    double zeta, size_t num_threads = 1);
+ErrorPair evaluate_cached_performance(const CorpusCache&, const FileList&, const CachedModel&,
+    double zeta, size_t num_threads = 1);
+
+#endif //CLASSIFIER_CORPUS_CACHE_H
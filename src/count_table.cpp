@@ -0,0 +1,211 @@
+#include "count_table.h"
+#include "ingest.h"
+#include "scheduler.h"
+#include "trace.h"
+
+/**** functions ****/
+
+ConcurrentCountTable::Generation::Generation(size_t capacity, Generation* older)
+    : capacity(capacity), slots(new Slot[capacity]), older(older)
+{
+}
+
+ConcurrentCountTable::Generation::~Generation()
+{
+    for (size_t i = 0; i < capacity; ++i)
+        delete slots[i].word.load();
+    delete[] slots;
+}
+
+ConcurrentCountTable::ConcurrentCountTable() : newest(new Generation(COUNT_TABLE_INITIAL_CAPACITY, nullptr))
+{
+}
+
+ConcurrentCountTable::~ConcurrentCountTable()
+{
+    Generation* generation = newest.load();
+    while (generation != nullptr)
+    {
+        Generation* older = generation->older;
+        delete generation;
+        generation = older;
+    }
+}
+
+void ConcurrentCountTable::add(const std::string& word, size_t count)
+{
+    uint64_t fingerprint = get_word_fingerprint(word);
+    const std::string* claim = nullptr;                     // copy of the word swapped into a free slot
+
+    while (true)
+    {
+        Generation* current = newest.load(std::memory_order_acquire);
+
+        // words are mostly counted where they were first claimed
+        for (Generation* generation = current; generation != nullptr; generation = generation->older)
+        {
+            Slot* slot = find(generation, word, fingerprint);
+            if (slot != nullptr && slot->word.load(std::memory_order_acquire) != nullptr)
+            {
+                slot->count.fetch_add(count, std::memory_order_relaxed);
+                delete claim;
+                return;
+            }
+        }
+
+        // claim a slot in the newest generation, unless it is too full
+        if (current->num_claimed.load(std::memory_order_relaxed) * 100 >= current->capacity * COUNT_TABLE_MAX_LOAD)
+        {
+            grow(current);
+            continue;
+        }
+
+        Slot* slot = find(current, word, fingerprint);
+        if (slot == nullptr)
+        {
+            grow(current);
+            continue;
+        }
+
+        if (claim == nullptr)
+            claim = new std::string(word);
+        const std::string* expected = nullptr;
+        if (slot->word.compare_exchange_strong(expected, claim, std::memory_order_acq_rel))
+        {
+            current->num_claimed.fetch_add(1, std::memory_order_relaxed);
+            slot->fingerprint.store(fingerprint, std::memory_order_release);
+            slot->count.fetch_add(count, std::memory_order_relaxed);
+            return;
+        }
+        if (holds(*slot, expected, word, fingerprint))
+        {
+            slot->count.fetch_add(count, std::memory_order_relaxed);
+            delete claim;
+            return;
+        }
+        // another word claimed the slot first; probe again
+    }
+}
+
+/**
+ * finds the slot of a word by linear probing
+ *
+ * @return the slot holding the word or the first free slot on its probe sequence;
+ *  nullptr if the generation is full
+ */
+ConcurrentCountTable::Slot* ConcurrentCountTable::find(Generation* generation, const std::string& word,
+    uint64_t fingerprint) const
+{
+    size_t mask = generation->capacity - 1;
+    for (size_t i = 0, index = fingerprint & mask; i < generation->capacity; ++i, index = (index + 1) & mask)
+    {
+        const std::string* slot_word = generation->slots[index].word.load(std::memory_order_acquire);
+        if (slot_word == nullptr || holds(generation->slots[index], slot_word, word, fingerprint))
+            return &generation->slots[index];
+    }
+    return nullptr;
+}
+
+/**
+ * tells whether a claimed slot holds a word; the words are only compared when the fingerprints
+ * match, or when the slot was claimed so recently that its fingerprint is not set yet
+ *
+ * @param slot_word : word of the slot, already loaded
+ */
+bool ConcurrentCountTable::holds(const Slot& slot, const std::string* slot_word, const std::string& word,
+    uint64_t fingerprint)
+{
+    uint64_t slot_fingerprint = slot.fingerprint.load(std::memory_order_acquire);
+    return (slot_fingerprint == fingerprint || slot_fingerprint == 0) && *slot_word == word;
+}
+
+/**
+ * adds a generation twice as large as the full one in front of it, unless another thread already did
+ */
+void ConcurrentCountTable::grow(Generation* full)
+{
+    if (newest.load(std::memory_order_acquire) != full)
+        return;
+
+    Generation* larger = new Generation(full->capacity * 2, full);
+    Generation* expected = full;
+    if (!newest.compare_exchange_strong(expected, larger, std::memory_order_acq_rel))
+    {
+        larger->older = nullptr;
+        delete larger;
+    }
+}
+
+FreqDict ConcurrentCountTable::get_word_freq() const
+{
+    FreqDict word_freq;
+    for (Generation* generation = newest.load(); generation != nullptr; generation = generation->older)
+    {
+        for (size_t i = 0; i < generation->capacity; ++i)
+        {
+            const std::string* word = generation->slots[i].word.load();
+            if (word != nullptr)
+                word_freq[*word] += generation->slots[i].count.load();
+        }
+    }
+    return word_freq;
+}
+
+size_t ConcurrentCountTable::get_num_generations() const
+{
+    size_t num_generations = 0;
+    for (Generation* generation = newest.load(); generation != nullptr; generation = generation->older)
+        ++num_generations;
+    return num_generations;
+}
+
+/**
+ * calculates a 64-bit FNV-1a fingerprint of a word; 0 marks slots whose fingerprint is not set
+ * yet, and is never returned
+ *
+ * @param word : the word
+ * @return fingerprint of the word
+ */
+uint64_t get_word_fingerprint(const std::string& word)
+{
+    uint64_t fingerprint = 14695981039346656037ULL;
+    for (unsigned char c : word)
+    {
+        fingerprint ^= c;
+        fingerprint *= 1099511628211ULL;
+    }
+    return fingerprint != 0 ? fingerprint : 1;
+}
+
+/**
+ * counts the words of the given files with several threads sharing a single count table; the files
+ * are read many at once by read_files(), and counted on a work-stealing TaskScheduler as soon as
+ * they were read, large files split into byte ranges
+ *
+ * @param files : the files
+ * @param num_threads : number of threads counting words
+ * @return frequency of every word in the files; the same as get_word_freq_in_files(files)
+ */
+FreqDict get_word_freq_in_files(const FileList& files, size_t num_threads)
+{
+    ConcurrentCountTable table;
+    {
+        TaskScheduler scheduler(num_threads);
+        read_files(files, [&](size_t, std::string& contents, bool)
+        {
+            // unreadable files have no words, as with get_word_freq_in_files(files)
+            scheduler.wait_until_below(SCHEDULER_MAX_UNFINISHED);
+            submit_word_freq_in_buffer(scheduler, std::make_shared<const std::string>(std::move(contents)),
+                [&table](FreqDict& word_freq)
+                {
+                    TraceSpan span("count");
+                    for (const auto& word : word_freq)
+                        table.add(word.first, word.second);
+                });
+        }, num_threads);
+        scheduler.wait();
+    }
+
+    TraceSpan span("merge");
+    return table.get_word_freq();
+}
@@ -0,0 +1,77 @@
+#ifndef CLASSIFIER_COUNT_TABLE_H
+#define CLASSIFIER_COUNT_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "util.h"
+
+// number of slots of the first generation of a count table; a power of two
+#define COUNT_TABLE_INITIAL_CAPACITY (1 << 16)
+
+// percentage of the slots of a generation that may be claimed before a larger one is added
+#define COUNT_TABLE_MAX_LOAD 70
+
+/**
+ * lock-free table counting words, shared by any number of threads. words are kept in
+ * open-addressing tables whose slots are claimed by swapping a copy of the word in with
+ * compare-and-swap, and counted with atomic additions. slots also hold a 64-bit fingerprint of
+ * their word, so that probing only compares the words themselves when fingerprints match. a full
+ * table is never copied: a twice larger generation is added in front of it, words already counted
+ * in an older generation keep being counted there, and new words go to the newest one. a word
+ * raced into two generations is merged when the counts are read
+ */
+class ConcurrentCountTable
+{
+public:
+    ConcurrentCountTable();
+    ~ConcurrentCountTable();
+    ConcurrentCountTable(const ConcurrentCountTable&) = delete;
+    ConcurrentCountTable& operator=(const ConcurrentCountTable&) = delete;
+
+    /**
+     * adds count to the frequency of a word; safe to call from any number of threads at once
+     */
+    void add(const std::string& word, size_t count = 1);
+
+    /**
+     * @return frequency of every counted word; must not run concurrently with add()
+     */
+    FreqDict get_word_freq() const;
+
+    /**
+     * @return number of generations; grows by one every time the table fills up
+     */
+    size_t get_num_generations() const;
+
+private:
+    struct Slot
+    {
+        std::atomic<const std::string*> word{nullptr};      // nullptr while the slot is free
+        std::atomic<uint64_t> fingerprint{0};               // set once the word is; 0 until then
+        std::atomic<size_t> count{0};
+    };
+
+    struct Generation
+    {
+        explicit Generation(size_t capacity, Generation* older);
+        ~Generation();
+
+        size_t capacity;                                    // a power of two
+        Slot* slots;
+        std::atomic<size_t> num_claimed{0};
+        Generation* older;
+    };
+
+    Slot* find(Generation* generation, const std::string& word, uint64_t fingerprint) const;
+    static bool holds(const Slot& slot, const std::string* slot_word, const std::string& word, uint64_t fingerprint);
+    void grow(Generation* full);
+
+    std::atomic<Generation*> newest;
+};
+
+/**** function prototypes ****/
+uint64_t get_word_fingerprint(const std::string&);
+FreqDict get_word_freq_in_files(const FileList&, size_t);
+
+#endif //CLASSIFIER_COUNT_TABLE_H
@@ -0,0 +1,176 @@
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include "cross_validation.h"
+#include "scheduler.h"
+#include "trace.h"
+
+/**** functions ****/
+
+/**
+ * splits labeled emails into folds of (nearly) equal sizes at random. stratified folds also hold
+ * (nearly) the same share of spam as the whole set, which matters when one class is rare
+ *
+ * @param file_lists_by_category : a two-element array of the spam and ham files
+ * @param num_folds : number of folds, at least 2 and at most the number of emails
+ * @param stratified : whether the spam and ham emails are each spread evenly over the folds
+ * @param seed : seed of the shuffle; the same seed always gives the same folds
+ * @return fold of every email, the spam emails first and then the ham emails
+ */
+std::vector<size_t> assign_folds(const FileListPair& file_lists_by_category, size_t num_folds, bool stratified,
+    uint64_t seed)
+{
+    size_t num_spam = file_lists_by_category[0].size();
+    size_t num_emails = num_spam + file_lists_by_category[1].size();
+    if (num_folds < 2 || num_folds > num_emails)
+        throw std::invalid_argument("cannot split " + std::to_string(num_emails) + " emails into "
+            + std::to_string(num_folds) + " folds");
+
+    // the emails to be shuffled together: either class on its own, or both at once
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (stratified)
+        ranges = {{0, num_spam}, {num_spam, num_emails}};
+    else
+        ranges = {{0, num_emails}};
+
+    // Fisher-Yates, drawing from a generator whose output the standard fixes, unlike the
+    // distributions and std::shuffle, so that folds do not depend on the standard library
+    std::mt19937_64 generator(seed);
+    std::vector<size_t> folds(num_emails);
+    size_t next_fold = 0;
+    for (const auto& range : ranges)
+    {
+        std::vector<size_t> order;
+        for (size_t i = range.first; i < range.second; ++i)
+            order.push_back(i);
+        for (size_t i = order.size(); i > 1; --i)
+            std::swap(order[i - 1], order[generator() % i]);
+
+        // dealt in turn, going on from where the previous class stopped, so that fold sizes differ by one at most
+        for (size_t email : order)
+        {
+            folds[email] = next_fold;
+            next_fold = (next_fold + 1) % num_folds;
+        }
+    }
+    return folds;
+}
+
+/**
+ * estimates the performance of the filter on emails it was not trained on by k-fold cross-validation:
+ * every fold is classified by a model trained on all the other folds. the emails are tokenized
+ * once, and rather than being trained again, the model of a fold is the model of all the emails
+ * less the counts of the fold
+ *
+ * @param cache : cache holding every email of file_lists_by_category
+ * @param file_lists_by_category : a two-element array of the spam and ham files
+ * @param folds : fold of every email, from assign_folds()
+ * @param num_folds : number of folds
+ * @param zeta : decision factor; see classify_new_email()
+ * @param prior_by_category : prior probabilities of SPAM and HAM
+ * @param num_threads : number of threads; more than one evaluate folds in parallel on a TaskScheduler
+ * @return performance matrix of every fold; see PerformanceMatrix
+ */
+std::vector<PerformanceMatrix> cross_validate(const CorpusCache& cache, const FileListPair& file_lists_by_category,
+    const std::vector<size_t>& folds, size_t num_folds, double zeta, const ProbPair& prior_by_category,
+    size_t num_threads)
+{
+    TraceSpan span("cross_validate");
+    CachedModel model = learn_cached_distributions(cache, file_lists_by_category, prior_by_category);
+    std::vector<PerformanceMatrix> perf_mats(num_folds, Eigen::Matrix2i::Zero());
+
+    auto evaluate_fold = [&](size_t fold)
+    {
+        TraceSpan fold_span("evaluate_fold");
+        CachedModel fold_model = get_fold_model(cache, file_lists_by_category, folds, fold, model);
+
+        size_t email = 0;
+        for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+            for (const FilePath& file : file_lists_by_category[c])
+                if (folds[email++] == fold)
+                    perf_mats[fold](c, classify_token_counts(get_cached_email(cache, file), fold_model, zeta).first) += 1;
+    };
+
+    if (num_threads > 1)
+    {
+        TaskScheduler scheduler(num_threads);
+        for (size_t fold = 0; fold < num_folds; ++fold)
+            scheduler.submit([&evaluate_fold, fold]() { evaluate_fold(fold); });
+        scheduler.wait();
+    }
+    else
+    {
+        for (size_t fold = 0; fold < num_folds; ++fold)
+            evaluate_fold(fold);
+    }
+
+    return perf_mats;
+}
+
+/**
+ * derives the model trained on every fold but one from the model trained on all of them, in
+ * time proportional to the size of the vocabulary and of the left out fold
+ *
+ * @param cache : cache holding every email of file_lists_by_category
+ * @param file_lists_by_category : a two-element array of the spam and ham files
+ * @param folds : fold of every email, from assign_folds()
+ * @param fold : the fold left out
+ * @param model : model trained on every email of file_lists_by_category
+ * @return model trained on the emails of every other fold
+ */
+CachedModel get_fold_model(const CorpusCache& cache, const FileListPair& file_lists_by_category,
+    const std::vector<size_t>& folds, size_t fold, const CachedModel& model)
+{
+    CachedModel fold_model = model;
+    size_t email = 0;
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        for (const FilePath& file : file_lists_by_category[c])
+        {
+            if (folds[email++] != fold)
+                continue;
+            for (const TokenCount& token : get_cached_email(cache, file))
+                fold_model.freq_by_category[c][token.first] -= token.second;
+            --fold_model.num_emails_by_category[c];
+        }
+    }
+    return fold_model;
+}
+
+/**
+ * prints the type 1 and type 2 errors of every fold, their means and standard deviations over
+ * the folds, and the errors over all the emails
+ *
+ * @param perf_mats : output of the cross_validate() function
+ * @param out : where the report is written
+ */
+void print_cross_validation(const std::vector<PerformanceMatrix>& perf_mats, std::ostream& out)
+{
+    PerformanceMatrix total = Eigen::Matrix2i::Zero();
+    ErrorPair mean = {0.0, 0.0}, square_mean = {0.0, 0.0};
+
+    out << std::fixed << std::setprecision(4);
+    for (size_t fold = 0; fold < perf_mats.size(); ++fold)
+    {
+        const PerformanceMatrix& perf_mat = perf_mats[fold];
+        ErrorPair errors = get_errors(perf_mat);
+        out << "Fold " << fold + 1 << ": " << perf_mat(0,0) + perf_mat(0,1) << " spam and "
+            << perf_mat(1,0) + perf_mat(1,1) << " ham emails, type 1 error " << errors[0]
+            << ", type 2 error " << errors[1] << "\n";
+
+        total += perf_mat;
+        for (size_t i = 0; i < 2; ++i)
+        {
+            mean[i] += errors[i] / (double) perf_mats.size();
+            square_mean[i] += errors[i] * errors[i] / (double) perf_mats.size();
+        }
+    }
+
+    ErrorPair errors = get_errors(total);
+    out << "Mean over " << perf_mats.size() << " folds: type 1 error " << mean[0] << " (sd "
+        << std::sqrt(std::max(0.0, square_mean[0] - mean[0] * mean[0])) << "), type 2 error " << mean[1] << " (sd "
+        << std::sqrt(std::max(0.0, square_mean[1] - mean[1] * mean[1])) << ")\n"
+        << "Over all emails: type 1 error " << errors[0] << ", type 2 error " << errors[1] << std::endl;
+    out << std::defaultfloat << std::setprecision(6);
+}
@@ -0,0 +1,23 @@
+#ifndef CLASSIFIER_CROSS_VALIDATION_H
+#define CLASSIFIER_CROSS_VALIDATION_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "corpus_cache.h"
+
+// default number of folds the labeled emails are split into
+#define CROSS_VALIDATION_FOLDS 10
+
+// seed of the shuffle assigning emails to folds, so that every run makes the same folds
+#define CROSS_VALIDATION_SEED 1
+
+/**** function prototypes ****/
+std::vector<size_t> assign_folds(const FileListPair&, size_t, bool, uint64_t seed = CROSS_VALIDATION_SEED);
+std::vector<PerformanceMatrix> cross_validate(const CorpusCache&, const FileListPair&, const std::vector<size_t>&,
+    size_t, double, const ProbPair& prior_by_category = {SPAM_PRIOR, HAM_PRIOR}, size_t num_threads = 1);
+CachedModel get_fold_model(const CorpusCache&, const FileListPair&, const std::vector<size_t>&, size_t,
+    const CachedModel&);
+void print_cross_validation(const std::vector<PerformanceMatrix>&, std::ostream&);
+
+#endif //CLASSIFIER_CROSS_VALIDATION_H
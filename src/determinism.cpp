@@ -0,0 +1,128 @@
+#include <cstdlib>
+#include "determinism.h"
+#include "filter.h"
+#include "scheduler.h"
+
+/**** function prototypes ****/
+bool models_are_identical(const Model&, const Model&);
+bool write_large_email(const FileList&, const FilePath&);
+
+/**** functions ****/
+
+/**
+ * checks that training and classifying give bit-identical results at every given number of
+ * threads: the model learned at each number of threads must hold the same counts and priors as the
+ * one learned by a single thread, and every test email must get exactly the same class and log
+ * probabilities, in every scoring mode. the log probabilities are compared with ==, not within a
+ * tolerance, since any difference means the floating-point additions happened in another order.
+ * an email larger than SCHEDULER_SPLIT_BYTES, made of the test emails, is added to the spam
+ * training emails and to the test emails, so that the splitting of large emails into ranges is
+ * checked too
+ *
+ * @param training_files : FileListPair of [spam emails, ham emails] to learn from
+ * @param test_files : emails to be classified
+ * @param thread_counts : numbers of threads to check, compared against a single thread
+ * @param zeta : decision factor; see classify_new_email()
+ * @param out : stream one line per mismatch, and a summary, are written to
+ * @return whether all results were identical
+ */
+bool check_determinism(const FileListPair& given_training_files, const FileList& given_test_files,
+    const std::vector<size_t>& thread_counts, double zeta, std::ostream& out)
+{
+    static const ScoringMode modes[] = {ScoringMode::FULL_SCAN, ScoringMode::SIGNIFICANT_WORDS,
+                                        ScoringMode::EARLY_EXIT, ScoringMode::STREAMING};
+    static const char* mode_names[] = {"full scan", "significant words", "early exit", "streaming"};
+
+    const char* tmp_dir = std::getenv("TMPDIR");
+    fs::path work_dir = fs::path(tmp_dir ? tmp_dir : "/tmp") / fs::unique_path("spamfilter-determinism-%%%%%%%%");
+    fs::create_directories(work_dir);
+    FileListPair training_files = given_training_files;
+    FileList test_files = given_test_files;
+    FilePath large_email = (work_dir / "large.txt").string();
+    if (write_large_email(given_test_files, large_email))
+    {
+        training_files[0].push_back(large_email);
+        test_files.push_back(large_email);
+    }
+
+    // reference results, from a single thread
+    Model reference_model = learn_distributions(training_files, {SPAM_PRIOR, HAM_PRIOR}, 1);
+    std::vector<std::vector<Classification>> reference_results;
+    std::vector<size_t> bytes_saved;
+    std::vector<char> truncated;
+    for (ScoringMode mode : modes)
+        reference_results.push_back(classify_files(test_files, reference_model, zeta, mode, 1, bytes_saved, truncated));
+
+    size_t num_mismatches = 0;
+    for (size_t num_threads : thread_counts)
+    {
+        Model model = learn_distributions(training_files, {SPAM_PRIOR, HAM_PRIOR}, num_threads);
+        if (!models_are_identical(model, reference_model))
+        {
+            out << num_threads << " threads: learned model differs from the single-threaded one" << std::endl;
+            ++num_mismatches;
+        }
+
+        // emails are scored against the reference model, so that a difference in scores is not
+        // merely a consequence of a difference in models
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+        {
+            std::vector<Classification> results = classify_files(test_files, reference_model, zeta, modes[m],
+                num_threads, bytes_saved, truncated);
+            for (size_t i = 0; i < test_files.size(); ++i)
+            {
+                if (results[i] != reference_results[m][i])
+                {
+                    out << num_threads << " threads, " << mode_names[m] << ": " << test_files[i]
+                        << " scored differently from the single-threaded run" << std::endl;
+                    ++num_mismatches;
+                }
+            }
+        }
+    }
+
+    out << "Checked " << thread_counts.size() << " thread counts on " << training_files[0].size()
+        << " spam and " << training_files[1].size() << " ham training emails, and " << test_files.size()
+        << " test emails: " << num_mismatches << " mismatches" << std::endl;
+
+    fs::remove_all(work_dir);
+    return num_mismatches == 0;
+}
+
+/**
+ * compares two models for exact equality of their counts and priors
+ *
+ * @param a : first model
+ * @param b : second model
+ * @return whether the models are identical
+ */
+bool models_are_identical(const Model& a, const Model& b)
+{
+    return a.num_emails_by_category == b.num_emails_by_category
+        && a.prior_by_category == b.prior_by_category
+        && a.freq_by_category == b.freq_by_category;
+}
+
+/**
+ * writes an email larger than SCHEDULER_SPLIT_BYTES by repeating the contents of other emails,
+ * so that it is split into several ranges when counted by more than one thread
+ *
+ * @param emails : emails whose contents are repeated
+ * @param email_path : path of the file to be written
+ * @return false if none of the emails has any contents, or the file could not be written
+ */
+bool write_large_email(const FileList& emails, const FilePath& email_path)
+{
+    std::string large_email, contents;
+    for (size_t i = 0; large_email.size() <= 2 * SCHEDULER_SPLIT_BYTES; ++i)
+    {
+        if (i == emails.size() && large_email.empty())
+            return false;
+        if (read_file(emails[i % emails.size()], contents))
+            large_email += contents + "\n";
+    }
+
+    std::ofstream file(email_path, std::ios::binary);
+    file << large_email;
+    return (bool) file;
+}
@@ -0,0 +1,11 @@
+#ifndef CLASSIFIER_DETERMINISM_H
+#define CLASSIFIER_DETERMINISM_H
+
+#include <iostream>
+#include <vector>
+#include "util.h"
+
+/**** function prototypes ****/
+bool check_determinism(const FileListPair&, const FileList&, const std::vector<size_t>&, double, std::ostream&);
+
+#endif //CLASSIFIER_DETERMINISM_H
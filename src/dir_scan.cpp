@@ -0,0 +1,220 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include "dir_scan.h"
+#include "metrics.h"
+#include "trace.h"
+
+/**** type definitions ****/
+
+// directory entry as returned by the getdents64 system call
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**** functions ****/
+
+DirectoryScanner::DirectoryScanner(const DirPath& dir_path, const std::string& extension, bool recursive,
+    size_t num_threads) : extension(extension), recursive(recursive)
+{
+    // paths are absolute, as with fs::system_complete()
+    std::string dir = fs::system_complete(dir_path).string();
+    if (dir.empty() || dir.back() != '/')
+        dir.push_back('/');
+    dirs_left.push_back(dir);
+    num_dirs_pending = 1;
+
+    for (size_t i = 0; i < std::max<size_t>(num_threads, 1); ++i)
+        threads.emplace_back(&DirectoryScanner::scan_dirs, this);
+}
+
+DirectoryScanner::~DirectoryScanner()
+{
+    {
+        std::lock_guard<std::mutex> lock(dirs_mutex);
+        stopping = true;
+        dirs_left.clear();
+    }
+    dir_queued.notify_all();
+    batches.close();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+bool DirectoryScanner::next_batch(FileListing& batch)
+{
+    if (!batches.pop(batch))
+        return false;
+    count_metric(FILES_ENUMERATED, batch.size());
+    return true;
+}
+
+bool DirectoryScanner::next(FilePath& file_path)
+{
+    while (current_index >= current.size())
+    {
+        current_index = 0;
+        if (!batches.pop(current))
+            return false;
+        count_metric(FILES_ENUMERATED, current.size());
+    }
+    file_path = current.get_path(current_index++);
+    return true;
+}
+
+/**
+ * reads queued directories until every directory was read; the last thread to finish closes
+ * the queue of batches
+ */
+void DirectoryScanner::scan_dirs()
+{
+    FileListing batch;
+    while (true)
+    {
+        std::string dir;
+        {
+            std::unique_lock<std::mutex> lock(dirs_mutex);
+            dir_queued.wait(lock, [this] { return stopping || !dirs_left.empty() || num_dirs_pending == 0; });
+            if (stopping || dirs_left.empty())
+                break;
+            dir = std::move(dirs_left.front());
+            dirs_left.pop_front();
+        }
+
+        scan_dir(dir, batch);
+
+        std::lock_guard<std::mutex> lock(dirs_mutex);
+        if (--num_dirs_pending == 0)
+            dir_queued.notify_all();
+    }
+
+    flush(batch);
+    std::lock_guard<std::mutex> lock(dirs_mutex);
+    if (num_dirs_pending == 0 || stopping)
+        batches.close();
+}
+
+/**
+ * reads the entries of a directory with getdents64, adds its files with the extension to the
+ * batch, and queues its subdirectories when scanning recursively
+ *
+ * @param dir : path of the directory, ending with a '/'
+ * @param batch : batch of files being filled by the calling thread
+ */
+void DirectoryScanner::scan_dir(const std::string& dir, FileListing& batch)
+{
+    TraceSpan span("scan_dir");
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        ++num_errors;
+        return;
+    }
+
+    uint32_t dir_index = UINT32_MAX;
+    std::vector<char> buffer(DIR_SCAN_BUFFER_BYTES);
+    long num_read;
+    while ((num_read = syscall(SYS_getdents64, fd, buffer.data(), buffer.size())) > 0)
+    {
+        for (long offset = 0; offset < num_read;)
+        {
+            auto entry = (const LinuxDirent64*) (buffer.data() + offset);
+            offset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0)
+                continue;
+
+            // file systems that do not report entry types leave them to be looked up; symbolic links
+            // are listed like files, and never followed into directories
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN)
+            {
+                struct stat status;
+                if (fstatat(fd, name, &status, AT_SYMLINK_NOFOLLOW) == 0)
+                    type = S_ISDIR(status.st_mode) ? DT_DIR : DT_REG;
+            }
+
+            if (type == DT_DIR)
+            {
+                if (recursive)
+                {
+                    std::lock_guard<std::mutex> lock(dirs_mutex);
+                    dirs_left.push_back(dir + name + "/");
+                    ++num_dirs_pending;
+                    dir_queued.notify_one();
+                }
+                continue;
+            }
+
+            const char* dot = std::strrchr(name, '.');
+            if (dot == nullptr || extension != dot)
+                continue;
+
+            if (dir_index == UINT32_MAX || batch.dirs.empty() || batch.dirs.back() != dir)
+            {
+                batch.dirs.push_back(dir);
+                dir_index = (uint32_t) batch.dirs.size() - 1;
+            }
+            batch.entries.emplace_back(dir_index, (uint32_t) batch.names.size());
+            batch.names.append(name, std::strlen(name) + 1);
+
+            if (batch.size() >= DIR_SCAN_BATCH_SIZE)
+            {
+                flush(batch);
+                dir_index = UINT32_MAX;
+            }
+        }
+    }
+    if (num_read < 0)
+        ++num_errors;
+    close(fd);
+
+    // hand out the files of every directory as soon as it was read
+    flush(batch);
+}
+
+/**
+ * hands a non-empty batch to the consumer and starts a new one
+ */
+void DirectoryScanner::flush(FileListing& batch)
+{
+    if (batch.size() > 0)
+        batches.push(std::move(batch));
+    batch = FileListing();
+}
+
+/**
+ * lists the files with a given extension in a directory at once; see DirectoryScanner
+ *
+ * @param dir_path : path of the directory
+ * @param extension : extension of the files, including its dot
+ * @param recursive : whether to list the files of all subdirectories as well
+ * @param num_threads : number of threads reading directories
+ * @return absolute paths of the files
+ */
+FileListing scan_files_in_folder(const DirPath& dir_path, const std::string& extension, bool recursive,
+    size_t num_threads)
+{
+    DirectoryScanner scanner(dir_path, extension, recursive, num_threads);
+
+    FileListing listing, batch;
+    while (scanner.next_batch(batch))
+    {
+        uint32_t dir_offset = (uint32_t) listing.dirs.size();
+        uint32_t name_offset = (uint32_t) listing.names.size();
+        listing.dirs.insert(listing.dirs.end(), batch.dirs.begin(), batch.dirs.end());
+        listing.names += batch.names;
+        for (const auto& entry : batch.entries)
+            listing.entries.emplace_back(dir_offset + entry.first, name_offset + entry.second);
+    }
+    return listing;
+}
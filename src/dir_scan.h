@@ -0,0 +1,99 @@
+#ifndef CLASSIFIER_DIR_SCAN_H
+#define CLASSIFIER_DIR_SCAN_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "queue.h"
+#include "util.h"
+
+// size of the buffer directory entries are read into with a single getdents64 system call
+#define DIR_SCAN_BUFFER_BYTES (64 << 10)
+
+// maximum number of files handed to the consumer of a DirectoryScanner at once
+#define DIR_SCAN_BATCH_SIZE 1024
+
+// maximum number of batches waiting for the consumer of a DirectoryScanner
+#define DIR_SCAN_QUEUE_CAPACITY 64
+
+/**** type definitions ****/
+
+// compact list of file paths: the path of every directory is stored once, and the names of the
+// files back to back, each followed by a NUL
+struct FileListing
+{
+    std::vector<std::string> dirs;                          // directory paths, ending with a '/'
+    std::string names;
+    std::vector<std::pair<uint32_t, uint32_t>> entries;     // index in dirs, offset in names
+
+    size_t size() const { return entries.size(); }
+    FilePath get_path(size_t i) const { return dirs[entries[i].first] + (names.c_str() + entries[i].second); }
+};
+
+/**
+ * lists the files with a given extension in a directory, and optionally in all its subdirectories,
+ * with several threads reading directories with getdents64 at once. files are handed out in batches
+ * as soon as their directory was read, so that consumers can start before the scan is over; the
+ * files of a directory come in the order the file system lists them, and directories in no
+ * particular order
+ */
+class DirectoryScanner
+{
+public:
+    DirectoryScanner(const DirPath& dir_path, const std::string& extension = ".txt", bool recursive = false,
+                     size_t num_threads = 1);
+    ~DirectoryScanner();
+    DirectoryScanner(const DirectoryScanner&) = delete;
+    DirectoryScanner& operator=(const DirectoryScanner&) = delete;
+
+    /**
+     * takes the next batch of files, waiting until one is ready
+     *
+     * @return false once every file was handed out
+     */
+    bool next_batch(FileListing& batch);
+
+    /**
+     * takes the next file, waiting until one is ready
+     *
+     * @return false once every file was handed out
+     */
+    bool next(FilePath& file_path);
+
+    /**
+     * @return number of directories that could not be read so far
+     */
+    size_t get_num_errors() const { return num_errors; }
+
+private:
+    void scan_dirs();
+    void scan_dir(const std::string& dir, FileListing& batch);
+    void flush(FileListing& batch);
+
+    std::string extension;
+    bool recursive;
+
+    std::mutex dirs_mutex;                                  // guards the members below
+    std::condition_variable dir_queued;
+    std::deque<std::string> dirs_left;
+    size_t num_dirs_pending = 0;                            // queued or being read
+    bool stopping = false;
+
+    std::atomic<size_t> num_errors{0};
+    BoundedQueue<FileListing> batches{DIR_SCAN_QUEUE_CAPACITY};
+    std::vector<std::thread> threads;
+
+    FileListing current;                                    // batch being handed out by next()
+    size_t current_index = 0;
+};
+
+/**** function prototypes ****/
+FileListing scan_files_in_folder(const DirPath&, const std::string& extension = ".txt", bool recursive = false,
+    size_t num_threads = 1);
+
+#endif //CLASSIFIER_DIR_SCAN_H
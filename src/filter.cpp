@@ -0,0 +1,997 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+#include "count_table.h"
+#include "filter.h"
+#include "ingest.h"
+#include "metrics.h"
+#include "trace.h"
+#include "scheduler.h"
+
+/**** functions ****/
+
+/**
+ * estimates parameters P(w_i|SPAM) and P(w_i|HAM) for all w_i from the training set
+ *
+ * @param file_lists_by_category : a two-element array. the first element is a list of
+ *  spam files and the second element is a list of ham files
+ * @param prior_by_category : A two-element array as prior probability distribution
+ *  for SPAM and HAM email classes
+ * @param num_threads : number of threads counting words; more than one share a ConcurrentCountTable
+ * @return model holding the frequency of every word in the spam and ham emails and the number
+ *  of spam and ham emails, from which smoothed estimates of P(w_i|SPAM) and P(w_i|HAM) are
+ *  derived, along with the prior probabilities
+ */
+Model learn_distributions(const FileListPair& file_lists_by_category, const ProbPair& prior_by_category,
+    size_t num_threads)
+{
+    PhaseTimer timer(TRAIN_PHASE);
+    TraceSpan span("learn_distributions");
+    Model model;
+
+    // get word frequency in spam and ham emails in the training dataset [w_i] --> [f_i]
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        if (num_threads > 1)
+            model.freq_by_category[c] = get_word_freq_in_files(file_lists_by_category[c], num_threads);
+        else
+            model.freq_by_category[c] = get_word_freq_in_files(file_lists_by_category[c]);
+    }
+
+    // get number of spam and ham emails in the training dataset
+    model.num_emails_by_category[0] = file_lists_by_category[0].size();
+    model.num_emails_by_category[1] = file_lists_by_category[1].size();
+
+    model.prior_by_category = prior_by_category;
+    return model;
+}
+
+/**
+ * adds a labeled email to training counts, as if it had been part of the training set
+ *
+ * @param counts : the training counts to be updated
+ * @param email_word_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param email_class : label of the email
+ */
+void add_email_to_counts(TrainingCounts& counts, const FreqDict& email_word_freq, const EmailClass& email_class)
+{
+    FreqDict& class_freq = counts.freq_by_category[email_class];
+    for (const auto& word : email_word_freq)
+        class_freq[word.first] += word.second;
+
+    ++counts.num_emails_by_category[email_class];
+}
+
+/**
+ * removes a labeled email from training counts, as if it had never been part of the training set;
+ * words no email of the class contains anymore become unseen again. this undoes add_email_to_counts()
+ * in time proportional to the number of distinct words of the email
+ *
+ * @param counts : the training counts to be updated; they are left untouched if the email
+ *  cannot have been counted in them
+ * @param email_word_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param email_class : label the email was counted with
+ */
+void remove_email_from_counts(TrainingCounts& counts, const FreqDict& email_word_freq, const EmailClass& email_class)
+{
+    FreqDict& class_freq = counts.freq_by_category[email_class];
+
+    // check the whole email first, so that a bad request leaves the counts consistent
+    if (counts.num_emails_by_category[email_class] == 0)
+        throw std::invalid_argument("no email of the class left to remove");
+    for (const auto& word : email_word_freq)
+    {
+        auto it = class_freq.find(word.first);
+        if (it == class_freq.end() || it->second < word.second)
+            throw std::invalid_argument("email was not counted with this class: " + word.first);
+    }
+
+    for (const auto& word : email_word_freq)
+    {
+        auto it = class_freq.find(word.first);
+        it->second -= word.second;
+        if (it->second == 0)
+            class_freq.erase(it);
+    }
+
+    --counts.num_emails_by_category[email_class];
+}
+
+/**
+ * saves a model so that it can be loaded later without retraining. the file holds a header
+ * line, the number of spam and ham emails, the prior probabilities, and then, for either class,
+ * the number of words followed by one "word frequency" line per word, sorted by word
+ *
+ * @param model_path : path of the file to be written
+ * @param model : output of the learn_distributions() function
+ */
+void save_model(const FilePath& model_path, const Model& model)
+{
+    std::ofstream file(model_path);
+    if (!file)
+        throw std::runtime_error("cannot write model file " + model_path);
+
+    file << MODEL_FILE_HEADER << "\n";
+    file << model.num_emails_by_category[0] << " " << model.num_emails_by_category[1] << "\n";
+    file << std::setprecision(21) << model.prior_by_category[0] << " " << model.prior_by_category[1] << "\n";
+    // words are written in lexicographic order, so that equal models are saved as identical files
+    for (const FreqDict& freq_dict : model.freq_by_category)
+    {
+        file << freq_dict.size() << "\n";
+        for (const FreqDict::value_type* word : get_sorted_words(freq_dict))
+            file << word->first << " " << word->second << "\n";
+    }
+
+    if (!file)
+        throw std::runtime_error("cannot write model file " + model_path);
+}
+
+/**
+ * loads a model written by save_model(); models saved without priors get SPAM_PRIOR and HAM_PRIOR
+ *
+ * @param model_path : path of the model file
+ * @return model : see learn_distributions()
+ */
+Model load_model(const FilePath& model_path)
+{
+    std::ifstream file(model_path);
+    std::string header;
+    if (!std::getline(file, header) || (header != MODEL_FILE_HEADER && header != MODEL_FILE_HEADER_V1))
+        throw std::runtime_error("not a model file: " + model_path);
+
+    Model model;
+    model.prior_by_category = {SPAM_PRIOR, HAM_PRIOR};
+    file >> model.num_emails_by_category[0] >> model.num_emails_by_category[1];
+    if (header == MODEL_FILE_HEADER)
+        file >> model.prior_by_category[0] >> model.prior_by_category[1];
+
+    for (FreqDict& freq_dict : model.freq_by_category)
+    {
+        size_t num_words = 0;
+        file >> num_words;
+        freq_dict.reserve(num_words);
+
+        std::string word;
+        size_t freq;
+        for (size_t i = 0; i < num_words && file >> word >> freq; ++i)
+            freq_dict[word] = freq;
+    }
+
+    if (!file)
+        throw std::runtime_error("truncated model file: " + model_path);
+
+    return model;
+}
+
+/**
+ * uses naive Bayes classification to classify the email in the given file
+ *
+ * @param email_path : path of the file to be classified
+ * @param model : output of the learn_distributions() function
+ * @param zeta : decision factor; if [ln P(SPAM|Email)] > zeta * [ln P(HAM|Email)],
+ *  then the email will be classified as SPAM, and HAM otherwise (empirically optimized).
+ * @return classification result (std::pair<EmailClass, Prob>) for the given email.
+ *  the first element is of type EmailClass (SPAM or HAM) and the second element is a
+ *  two-element array as [ln P(SPAM|Email), ln P(HAM|Email)], representing the natural log of
+ *  posterior probabilities
+ */
+Classification classify_new_email(const FilePath& email_path, const Model& model, double zeta)
+{
+    TraceSpan span("classify_new_email");
+    // get frequency of words in email
+    FreqDict word_freq = get_word_freq_in_file(email_path);
+
+    return classify_word_freq(word_freq, model, zeta);
+}
+
+/**
+ * uses naive Bayes classification to classify an email held in memory
+ *
+ * @param data : the bytes of the email
+ * @param size : number of bytes of the email
+ * @param model : output of the learn_distributions() function
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_new_email_buffer(const char* data, size_t size, const Model& model, double zeta)
+{
+    // get frequency of words in email
+    FreqDict word_freq = get_word_freq_in_buffer(data, size);
+
+    return classify_word_freq(word_freq, model, zeta);
+}
+
+/**
+ * uses naive Bayes classification to classify the email in the given file, scoring only
+ * the words whose spam/ham log-ratio is furthest from zero. at most max_bytes bytes of the
+ * file are read, and every distinct word read is looked up once per class; the terms of the
+ * words selected are then summed as they are, without looking them up again, so that the work
+ * per email is bounded whatever the size of the file
+ *
+ * @param email_path : path of the file to be classified
+ * @param model : output of the learn_distributions() function
+ * @param num_words : maximum number of (distinct) words to be scored
+ * @param zeta : decision factor; see classify_new_email()
+ * @param max_bytes : maximum number of bytes of the file to be read; a word cut at max_bytes is ignored
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_new_email_significant(const FilePath& email_path, const Model& model,
+    size_t num_words, double zeta, size_t max_bytes)
+{
+    TraceSpan span("classify_new_email");
+    std::string contents;
+    bool truncated;
+    read_file_prefix(email_path, contents, max_bytes, truncated);
+
+    // get frequency of words in email and score only the most significant ones
+    FreqDict word_freq = get_word_freq_in_buffer(contents.data(), contents.size());
+    return classify_significant_words(select_significant_words(word_freq, model, num_words), model, zeta);
+}
+
+/**
+ * uses naive Bayes classification to classify the email in the given file, reading it
+ * word by word and stopping as soon as the rest of the file can no longer flip the decision
+ * [ln P(SPAM and Email)] > zeta * [ln P(HAM and Email)]. the classification is always the
+ * same as that of classify_new_email(); if the whole file had to be read, so are the
+ * posterior probabilities, otherwise they are those of the prefix of the email that was read
+ *
+ * @param email_path : path of the file to be classified
+ * @param model : output of the learn_distributions() function
+ * @param log_prob_bounds : output of get_log_prob_bounds() for the model
+ * @param bytes_saved : set to the number of bytes of the file that were left unread
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_new_email_early_exit(const FilePath& email_path, const Model& model,
+    const LogProbBounds& log_prob_bounds, size_t& bytes_saved, double zeta)
+{
+    std::ifstream file(email_path);
+    file.seekg(0, std::ios::end);
+    std::streamoff file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    PartialScores partial_scores;
+
+    bytes_saved = 0;
+    size_t words_read = 0;
+    std::string word;
+    while (file >> word)
+    {
+        add_word_to_scores(partial_scores, word, model);
+
+        if (++words_read % EARLY_EXIT_CHECK_INTERVAL != 0)
+            continue;
+
+        // every word is preceded by at least one whitespace, so at most half of the bytes
+        // left to read can be words
+        std::streamoff pos = file.tellg();
+        if (pos < 0)
+            break;
+        long double words_left = (long double) ((file_size - pos)/2);
+
+        // bounds on how much the words left can change [ln P(Class and Email)]: every word
+        // adds at least min ln P(w_i|Class) (if negative), and at most max ln P(w_i|Class)
+        // (if positive) plus the growth of the multinomial term, ln((num + 1)...(num + k))
+        ProbPair score = get_partial_scores(partial_scores, model);
+        ProbPair change_lo, change_hi;
+        for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+        {
+            long double num = partial_scores.num[c];
+            change_lo[c] = words_left * std::min(log_prob_bounds[c][0], (Prob) 0.0);
+            change_hi[c] = words_left * std::max(log_prob_bounds[c][1], (Prob) 0.0)
+                    + lgamma(num + words_left + 1.0) - lgamma(num + 1.0);
+        }
+
+        // decision margin [ln P(SPAM and Email)] - zeta * [ln P(HAM and Email)] and its bounds,
+        // with some slack for the rounding of the incremental sums
+        Prob margin = score[0] - zeta*score[1];
+        Prob margin_lo = margin + change_lo[0] - std::max(zeta*change_lo[1], zeta*change_hi[1]);
+        Prob margin_hi = margin + change_hi[0] - std::min(zeta*change_lo[1], zeta*change_hi[1]);
+        Prob slack = 1e-9 * (std::fabs(score[0]) + std::fabs(score[1]) + 1.0);
+
+        if (margin_lo > slack || margin_hi < -slack)
+        {
+            bytes_saved = (size_t) (file_size - pos);
+            count_metric(BYTES_READ, (uint64_t) pos);
+
+            Classification classify_result = classify_scores(get_partial_scores(partial_scores, model), zeta);
+            classify_result.first = (margin_lo > slack) ? EmailClass::SPAM : EmailClass::HAM;
+            return classify_result;
+        }
+    }
+
+    // the verdict could not be decided early; score the whole email exactly as a full scan would
+    count_metric(BYTES_READ, file_size > 0 ? (uint64_t) file_size : 0);
+    return classify_word_freq(partial_scores.word_freq, model, zeta);
+}
+
+/**
+ * uses naive Bayes classification to classify the email in the given file, reading it in
+ * chunks of STREAM_CHUNK_SIZE bytes and updating the scores of both classes word by word.
+ * at most max_bytes bytes of the file are read, which bounds the memory used per email
+ * regardless of its size: if the file is longer, the rest of it is ignored, and so is a word
+ * cut in two at max_bytes. the posterior probabilities are the same as those of
+ * classify_new_email() up to rounding if the file is read in full
+ *
+ * @param email_path : path of the file to be classified
+ * @param model : output of the learn_distributions() function
+ * @param truncated : set to whether the file was longer than max_bytes
+ * @param max_bytes : maximum number of bytes of the file to be read
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_new_email_streaming(const FilePath& email_path, const Model& model,
+    bool& truncated, size_t max_bytes, double zeta)
+{
+    std::ifstream file(email_path, std::ios::binary);
+    std::array<char, STREAM_CHUNK_SIZE> chunk;
+    PartialScores partial_scores;
+
+    // a word straddling two chunks is carried over to the next one
+    std::string word;
+    size_t bytes_left = max_bytes;
+    truncated = false;
+
+    while (bytes_left > 0 && file)
+    {
+        file.read(chunk.data(), (std::streamsize) std::min(chunk.size(), bytes_left));
+        size_t chunk_size = (size_t) file.gcount();
+        bytes_left -= chunk_size;
+
+        for (size_t i = 0; i < chunk_size; ++i)
+        {
+            if (!std::isspace((unsigned char) chunk[i]))
+                word.push_back(chunk[i]);
+            else if (!word.empty())
+            {
+                add_word_to_scores(partial_scores, word, model);
+                word.clear();
+            }
+        }
+    }
+
+    // a word cut at max_bytes is only complete if it is followed by a whitespace
+    if (bytes_left == 0 && file.peek() != std::ifstream::traits_type::eof())
+    {
+        truncated = true;
+        if (!std::isspace(file.peek()))
+            word.clear();
+    }
+    if (!word.empty())
+        add_word_to_scores(partial_scores, word, model);
+
+    count_metric(BYTES_READ, max_bytes - bytes_left);
+    return classify_scores(get_partial_scores(partial_scores, model), zeta);
+}
+
+/**
+ * adds one occurrence of a word to the running scores of an email; after all the words of an
+ * email are added, the scores are those calculated by prob_class_intrsct_words() (up to rounding)
+ *
+ * @param partial_scores : running scores of the email
+ * @param word : the word that was read
+ * @param model : output of the learn_distributions() function
+ */
+void add_word_to_scores(PartialScores& partial_scores, const std::string& word, const Model& model)
+{
+    size_t prev_freq = partial_scores.word_freq[word]++;
+
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        size_t class_freq;
+
+        // unseen words contribute their smoothed estimate once, regardless of frequency
+        if (!get_word_freq_given_class(model, word, (EmailClass) c, class_freq))
+        {
+            if (prev_freq == 0)
+            {
+                partial_scores.log_prob_words[c] += log_prob_word_given_class(model, word, (EmailClass) c);
+                partial_scores.num[c] += 1;
+            }
+        }
+        else
+        {
+            partial_scores.log_prob_words[c] += log_prob_word_given_class(model, word, (EmailClass) c);
+            partial_scores.num[c] += 1;
+            partial_scores.den[c] += log((long double) prev_freq + 1.0); // lgamma(f + 2) - lgamma(f + 1)
+        }
+    }
+}
+
+/**
+ * calculates [ln P(Class and Email)] for both classes from the running scores of an email
+ *
+ * @param partial_scores : running scores of the email
+ * @param model : output of the learn_distributions() function
+ * @return two-element array as [ln P(SPAM and Email), ln P(HAM and Email)]
+ */
+ProbPair get_partial_scores(const PartialScores& partial_scores, const Model& model)
+{
+    ProbPair scores;
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+        scores[c] = log(model.prior_by_category[c]) + lgamma(partial_scores.num[c] + 1.0)
+                - partial_scores.den[c] + partial_scores.log_prob_words[c];
+
+    return scores;
+}
+
+/**
+ * decides the class of an email given [ln P(SPAM and Email)] and [ln P(HAM and Email)]
+ *
+ * @param scores : two-element array as [ln P(SPAM and Email), ln P(HAM and Email)]
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_scores(const ProbPair& scores, double zeta)
+{
+    Classification classify_result;
+    Prob spam_intrsct_words = scores[0];
+    Prob ham_intrsct_words = scores[1];
+
+    // decide email class
+    if (spam_intrsct_words > zeta*ham_intrsct_words)
+        classify_result.first = EmailClass::SPAM;
+    else
+        classify_result.first = EmailClass::HAM;
+
+    // calculate [ln P(SPAM|Email)] and [ln P(HAM|Email)]
+    Prob spam_given_email = spam_intrsct_words - log(exp(spam_intrsct_words) + exp(ham_intrsct_words));
+    Prob ham_given_email = ham_intrsct_words - log(exp(spam_intrsct_words) + exp(ham_intrsct_words));
+
+    classify_result.second = {spam_given_email, ham_given_email};
+    return classify_result;
+}
+
+/**
+ * finds the smallest and largest values of [ln P(w_i|Class)] in either class, including
+ * the smoothed estimate for unseen words; used to bound the contribution of unread words
+ *
+ * @param model : output of the learn_distributions() function
+ * @return two-element array whose elements are [min ln P(w_i|SPAM), max ln P(w_i|SPAM)]
+ *  and [min ln P(w_i|HAM), max ln P(w_i|HAM)]
+ */
+LogProbBounds get_log_prob_bounds(const Model& model)
+{
+    LogProbBounds log_prob_bounds;
+
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        // ln P(w_i|Class) grows with f_i, and unseen words count as f_i = 0
+        size_t min_freq = 0, max_freq = 0;
+        for (const auto& word : model.freq_by_category[c])
+            max_freq = std::max(max_freq, word.second);
+
+        Prob num_class_emails = (Prob) (model.num_emails_by_category[c] + 2);
+        log_prob_bounds[c] = {log((Prob) (min_freq + 1)/ num_class_emails), log((Prob) (max_freq + 1)/ num_class_emails)};
+    }
+
+    return log_prob_bounds;
+}
+
+/**
+ * classifies an email given the frequency of its words; shared by all scoring modes
+ *
+ * @param word_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param model : output of the learn_distributions() function
+ * @param zeta : decision factor; see classify_new_email()
+ * @param delta : optional counts of emails added on top of the model's training set, for
+ *  example those of a single user; see prob_class_intrsct_words()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_word_freq(const FreqDict& word_freq, const Model& model, double zeta,
+    const TrainingCounts* delta)
+{
+    // calculate probability of spam and ham intersect with words in the email, sorting its words once for both
+    std::vector<const FreqDict::value_type*> sorted_words = get_sorted_words(word_freq);
+    Prob spam_intrsct_words = prob_class_intrsct_words(model, word_freq, sorted_words, EmailClass::SPAM, delta);
+    Prob ham_intrsct_words = prob_class_intrsct_words(model, word_freq, sorted_words, EmailClass::HAM, delta);
+
+    return classify_scores({spam_intrsct_words, ham_intrsct_words}, zeta);
+}
+
+/**
+ * selects the num_words words of the email whose log-ratio |ln P(w_i|SPAM) - ln P(w_i|HAM)|
+ * is the largest, using a bounded min-heap over a single scan of the email's words; every word
+ * is looked up once per class, and the terms of the words kept are returned with them
+ *
+ * @param word_email_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param model : output of the learn_distributions() function
+ * @param num_words : maximum number of words to be selected
+ * @return (at most) num_words words of word_email_freq, with their [ln P(w_i|Class)]
+ */
+std::vector<SignificantWord> select_significant_words(const FreqDict& word_email_freq, const Model& model,
+    size_t num_words)
+{
+    // min-heap on |log-ratio|, so that the least significant of the kept words is on top; ties are
+    // broken by the words themselves, so that the same words are kept whatever the dictionary's layout
+    auto less_significant = [](const SignificantWord& a, const SignificantWord& b)
+    {
+        return a.log_ratio < b.log_ratio || (a.log_ratio == b.log_ratio && a.word->first < b.word->first);
+    };
+    auto more_significant = [&less_significant](const SignificantWord& a, const SignificantWord& b)
+    {
+        return less_significant(b, a);
+    };
+    std::priority_queue<SignificantWord, std::vector<SignificantWord>, decltype(more_significant)> heap(more_significant);
+    if (num_words == 0)
+        return {};
+
+    for (const auto& word : word_email_freq)
+    {
+        // same estimate as log_prob_word_given_class(), from a single lookup per class
+        SignificantWord rated_word;
+        rated_word.word = &word;
+        for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+        {
+            size_t class_freq;
+            rated_word.seen[c] = get_word_freq_given_class(model, word.first, (EmailClass) c, class_freq);
+            rated_word.log_prob[c] = log((Prob) (class_freq + 1)/ (Prob) (model.num_emails_by_category[c] + 2));
+        }
+        rated_word.log_ratio = std::fabs(rated_word.log_prob[0] - rated_word.log_prob[1]);
+
+        if (heap.size() < num_words)
+            heap.push(rated_word);
+        else if (less_significant(heap.top(), rated_word))
+        {
+            heap.pop();
+            heap.push(rated_word);
+        }
+    }
+
+    std::vector<SignificantWord> significant_words;
+    significant_words.reserve(heap.size());
+    for (; !heap.empty(); heap.pop())
+        significant_words.push_back(heap.top());
+
+    return significant_words;
+}
+
+/**
+ * selects the num_words words of the email whose log-ratio |ln P(w_i|SPAM) - ln P(w_i|HAM)|
+ * is the largest; see select_significant_words()
+ *
+ * @param word_email_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param model : output of the learn_distributions() function
+ * @param num_words : maximum number of words to be selected
+ * @return dictionary holding (at most) num_words entries of word_email_freq
+ */
+FreqDict get_significant_words(const FreqDict& word_email_freq, const Model& model, size_t num_words)
+{
+    FreqDict significant_freq;
+    for (const SignificantWord& word : select_significant_words(word_email_freq, model, num_words))
+        significant_freq.insert(*word.word);
+
+    return significant_freq;
+}
+
+/**
+ * classifies an email from its most significant words, summing the terms computed while they
+ * were selected in the same order as prob_class_intrsct_words() does, so that the result is the
+ * same as that of classify_word_freq() on get_significant_words()
+ *
+ * @param significant_words : output of the select_significant_words() function
+ * @param model : output of the learn_distributions() function
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_significant_words(std::vector<SignificantWord> significant_words, const Model& model,
+    double zeta)
+{
+    PhaseTimer timer(SCORE_PHASE);
+    TraceSpan span("score");
+    std::sort(significant_words.begin(), significant_words.end(),
+              [](const SignificantWord& a, const SignificantWord& b) { return a.word->first < b.word->first; });
+
+    ProbPair scores;
+    std::vector<Prob> den_terms;
+    std::vector<Prob> prob_word_given_class_terms;
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        long double num = 0.0;
+        den_terms.clear();
+        prob_word_given_class_terms.clear();
+        for (const SignificantWord& word : significant_words)
+        {
+            if (!word.seen[c])
+            {
+                prob_word_given_class_terms.push_back(word.log_prob[c]);
+                num += 1;
+            }
+            else
+            {
+                // log() gives a double, and so does its product with the frequency in prob_class_intrsct_words()
+                prob_word_given_class_terms.push_back((word.word->second)*(double) word.log_prob[c]);
+                num += word.word->second;
+                den_terms.push_back(lgamma(word.word->second + 1.0));
+            }
+        }
+        long double den = 1.0 + get_pairwise_sum(den_terms.data(), den_terms.size());
+
+        scores[c] = log(model.prior_by_category[c]);
+        scores[c] += lgamma(num + 1.0) - den;
+        scores[c] += get_pairwise_sum(prob_word_given_class_terms.data(), prob_word_given_class_terms.size());
+
+        if (metrics_enabled.load(std::memory_order_relaxed))
+        {
+            add_to_metric(MODEL_HITS, den_terms.size());
+            add_to_metric(MODEL_MISSES, significant_words.size() - den_terms.size());
+        }
+    }
+
+    return classify_scores(scores, zeta);
+}
+
+/**
+ * looks up the frequency of a word in the training emails of a class
+ *
+ * @param model : output of the learn_distributions() function
+ * @param word : the word w_i
+ * @param email_class : the class (SPAM or HAM)
+ * @param freq : set to f_i, the frequency of the word in the training emails of the class
+ * @param delta : optional counts of emails added on top of the model's training set
+ * @return whether the word was seen in the training emails of the class
+ */
+bool get_word_freq_given_class(const Model& model, const std::string& word, const EmailClass& email_class,
+    size_t& freq, const TrainingCounts* delta)
+{
+    freq = 0;
+    bool seen = false;
+
+    const FreqDict& class_freq = model.freq_by_category[email_class];
+    auto it = class_freq.find(word);
+    if (it != class_freq.end())
+    {
+        freq += it->second;
+        seen = true;
+    }
+
+    if (delta != nullptr)
+    {
+        const FreqDict& delta_freq = delta->freq_by_category[email_class];
+        auto delta_it = delta_freq.find(word);
+        if (delta_it != delta_freq.end())
+        {
+            freq += delta_it->second;
+            seen = true;
+        }
+    }
+
+    return seen;
+}
+
+/**
+ * calculates [ln P(w_i|Class)] from the smoothed estimate
+ * P(w_i|Class) = ((f_i|Class) + 1) / (#(Class) + 2), where unseen words have f_i = 0
+ *
+ * @param model : output of the learn_distributions() function
+ * @param word : the word w_i
+ * @param email_class : the class (SPAM or HAM)
+ * @param delta : optional counts of emails added on top of the model's training set
+ * @return natural log of the probability of the word appearing in an email of the class
+ */
+Prob log_prob_word_given_class(const Model& model, const std::string& word, const EmailClass& email_class,
+    const TrainingCounts* delta)
+{
+    size_t freq;
+    get_word_freq_given_class(model, word, email_class, freq, delta);
+
+    size_t num_class_emails = model.num_emails_by_category[email_class];
+    if (delta != nullptr)
+        num_class_emails += delta->num_emails_by_category[email_class];
+
+    return log((Prob) (freq + 1)/ (Prob) (num_class_emails + 2));
+}
+
+/**
+ * calculates [ln P(Email and Class)]; Email = W = {w_1, ..., w_n}, where w_i is
+ * a word in the email; Class corresponds to EmailClass = either SPAM or HAM;
+ * Note that, P(Email and Class) = P(Class)*P(Email|Class);
+ *
+ * @param model : output of the learn_distributions() function
+ * @param word_email_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param email_class : the class (SPAM or HAM)
+ * @param delta : optional counts of emails added on top of the model's training set; the email
+ *  is then scored, in the same single pass over its words, as if the model had been trained on
+ *  both, without copying the model
+ * @return probability of class intersect words of the email, that is, probability of both the
+ *  words and class appearing or taking place
+ */
+Prob prob_class_intrsct_words(const Model& model, const FreqDict& word_email_freq, const EmailClass& email_class,
+    const TrainingCounts* delta)
+{
+    return prob_class_intrsct_words(model, word_email_freq, get_sorted_words(word_email_freq), email_class, delta);
+}
+
+/**
+ * calculates [ln P(Email and Class)], going through words already sorted, so that an email
+ * scored in both classes is only sorted once; see prob_class_intrsct_words() above
+ *
+ * @param model : output of the learn_distributions() function
+ * @param word_email_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param sorted_words : output of get_sorted_words() on word_email_freq
+ * @param email_class : the class (SPAM or HAM)
+ * @param delta : optional counts of emails added on top of the model's training set
+ * @return probability of class intersect words of the email
+ */
+Prob prob_class_intrsct_words(const Model& model, const FreqDict& word_email_freq,
+    const std::vector<const FreqDict::value_type*>& sorted_words, const EmailClass& email_class,
+    const TrainingCounts* delta)
+{
+    // P(Class ⋂ Words) = P(Class) * P (Words|Class), where
+    // P(Words|Class) = (\sum w_i)!/(\prod w_i!) * (\prod P(w_i|Class)^f_(w_i))
+    PhaseTimer timer(SCORE_PHASE);
+    TraceSpan span("score");
+
+    // initialize intersection probability with prior class probability
+    Prob prob_cls_int_wrd = log(model.prior_by_category[email_class]);
+
+    // initialize numerator and denominator of the multinomial term
+    long double num = 0.0;
+    std::vector<Prob> den_terms;
+    std::vector<Prob> prob_word_given_class_terms; // ln()
+
+    size_t num_class_emails = model.num_emails_by_category[email_class];
+    if (delta != nullptr)
+        num_class_emails += delta->num_emails_by_category[email_class];
+
+    // calculate [ln P(Words|Class)] term by term, going through the words in lexicographic order, so
+    // that the score does not depend on the layout of the email's dictionary, which changes with the
+    // order its words were counted in
+    for (const FreqDict::value_type* word : sorted_words)
+    {
+        size_t class_freq;
+
+        // if word not seen before, update probability with a non-zero smoothed estimate
+        if (!get_word_freq_given_class(model, word->first, email_class, class_freq, delta))
+        {
+            prob_word_given_class_terms.push_back(log((Prob) 1/ (Prob) (num_class_emails + 2)));
+            num += 1;
+            // den += log(1)
+        }
+        else
+        {
+            prob_word_given_class_terms.push_back((word->second)*log((Prob) (class_freq + 1)/ (Prob) (num_class_emails + 2)));
+            num += word->second;
+            den_terms.push_back(lgamma(word->second + 1.0));
+        }
+    }
+    long double den = 1.0 + get_pairwise_sum(den_terms.data(), den_terms.size());
+    Prob prob_word_given_class = get_pairwise_sum(prob_word_given_class_terms.data(), prob_word_given_class_terms.size());
+
+    // update intersection probability
+    prob_cls_int_wrd += lgamma(num + 1.0) - den;
+    prob_cls_int_wrd += prob_word_given_class;
+
+    // every seen word, and only seen words, has a den term
+    if (metrics_enabled.load(std::memory_order_relaxed))
+    {
+        add_to_metric(MODEL_HITS, den_terms.size());
+        add_to_metric(MODEL_MISSES, word_email_freq.size() - den_terms.size());
+        add_to_metric(MODEL_PROBES, get_num_probes(model.freq_by_category[email_class], word_email_freq));
+    }
+
+    return prob_cls_int_wrd;
+}
+
+/**
+ * lists the entries of a dictionary in lexicographic order of their words
+ *
+ * @param word_freq : dictionary whose keys are words and values are their frequencies
+ * @return pointers to the entries of the dictionary, sorted by word
+ */
+std::vector<const FreqDict::value_type*> get_sorted_words(const FreqDict& word_freq)
+{
+    std::vector<const FreqDict::value_type*> sorted_words;
+    sorted_words.reserve(word_freq.size());
+    for (const auto& word : word_freq)
+        sorted_words.push_back(&word);
+
+    std::sort(sorted_words.begin(), sorted_words.end(),
+              [](const FreqDict::value_type* a, const FreqDict::value_type* b) { return a->first < b->first; });
+    return sorted_words;
+}
+
+/**
+ * adds terms in a fixed tree order: both halves are summed recursively, and then added together.
+ * the result only depends on the terms and their order, and its rounding error grows with the
+ * logarithm of the number of terms rather than linearly
+ *
+ * @param terms : the terms
+ * @param num_terms : number of terms
+ * @return sum of the terms
+ */
+Prob get_pairwise_sum(const Prob* terms, size_t num_terms)
+{
+    if (num_terms <= PAIRWISE_SUM_BLOCK)
+    {
+        Prob sum = 0.0;
+        for (size_t i = 0; i < num_terms; ++i)
+            sum += terms[i];
+        return sum;
+    }
+
+    size_t half = num_terms / 2;
+    return get_pairwise_sum(terms, half) + get_pairwise_sum(terms + half, num_terms - half);
+}
+
+/**
+ * classifies email files, each independently of the others, so that the results do not depend on
+ * the number of threads nor on the order the emails are scored in
+ *
+ * @param files : paths of the emails to be classified
+ * @param model : output of the learn_distributions() function
+ * @param zeta : decision factor; see evaluate_filter_performance()
+ * @param mode : scoring mode; see evaluate_filter_performance()
+ * @param num_threads : number of threads classifying emails; more than one run on a work-stealing
+ *  TaskScheduler. in the FULL_SCAN mode, emails are then read many at once by read_files(), and
+ *  large emails are split into byte ranges
+ * @param bytes_saved : filled with the number of bytes of each email left unread in the EARLY_EXIT mode
+ * @param truncated : filled with whether each email was longer than MAX_EMAIL_BYTES in the STREAMING mode
+ * @return classification of each email, in the order of files
+ */
+std::vector<Classification> classify_files(const FileList& files, const Model& model, double zeta,
+    ScoringMode mode, size_t num_threads, std::vector<size_t>& bytes_saved, std::vector<char>& truncated)
+{
+    // bounds on the contribution of a single word, for the EARLY_EXIT mode
+    LogProbBounds log_prob_bounds;
+    if (mode == ScoringMode::EARLY_EXIT)
+        log_prob_bounds = get_log_prob_bounds(model);
+
+    std::vector<Classification> classify_results(files.size());
+    bytes_saved.assign(files.size(), 0);
+    truncated.assign(files.size(), 0);
+
+    auto classify_email = [&](size_t i)
+    {
+        const FilePath& email = files[i];
+        if (mode == ScoringMode::SIGNIFICANT_WORDS)
+            classify_results[i] = classify_new_email_significant(email, model, NUM_SIGNIFICANT_WORDS, zeta);
+        else if (mode == ScoringMode::EARLY_EXIT)
+            classify_results[i] = classify_new_email_early_exit(email, model, log_prob_bounds, bytes_saved[i], zeta);
+        else if (mode == ScoringMode::STREAMING)
+        {
+            bool email_truncated = false;
+            classify_results[i] = classify_new_email_streaming(email, model, email_truncated, MAX_EMAIL_BYTES, zeta);
+            truncated[i] = email_truncated;
+        }
+        else
+            classify_results[i] = classify_new_email(email, model, zeta);
+    };
+
+    if (num_threads > 1 && mode == ScoringMode::FULL_SCAN)
+    {
+        // emails are read many at once, and scored as soon as they were read
+        TaskScheduler scheduler(num_threads);
+        read_files(files, [&](size_t i, std::string& contents, bool)
+        {
+            scheduler.wait_until_below(SCHEDULER_MAX_UNFINISHED);
+            submit_word_freq_in_buffer(scheduler, std::make_shared<const std::string>(std::move(contents)),
+                [&, i](FreqDict& word_freq)
+                {
+                    classify_results[i] = classify_word_freq(word_freq, model, zeta);
+                });
+        }, num_threads);
+        scheduler.wait();
+    }
+    else if (num_threads > 1)
+    {
+        // the other modes read emails themselves
+        TaskScheduler scheduler(num_threads);
+        for (size_t i = 0; i < files.size(); ++i)
+            scheduler.submit([&classify_email, i]() { classify_email(i); });
+        scheduler.wait();
+    }
+    else
+    {
+        for (size_t i = 0; i < files.size(); ++i)
+            classify_email(i);
+    }
+
+    return classify_results;
+}
+
+/**
+ * tests filter performance over the given email files
+ *
+ * @param test_dir : path to directory holding all test emails to be classified
+ * @param model : output of the learn_distributions() function
+ * @param zeta : decision factor; if [ln P(SPAM|Email)] > zeta * [ln P(HAM|Email)],
+ *  then the email will be classified as SPAM, and HAM otherwise (empirically optimized).
+ * @param mode : FULL_SCAN scores every word of an email; SIGNIFICANT_WORDS scores only the
+ *  NUM_SIGNIFICANT_WORDS words furthest from being neutral; EARLY_EXIT stops reading an email
+ *  once the rest of it cannot change the classification; STREAMING reads an email in fixed-size
+ *  chunks, and at most MAX_EMAIL_BYTES bytes of it
+ * @param num_threads : number of threads classifying emails; see classify_files()
+ * @return ErrorPair of [Type 1 error, Type 2 error] where type 1 error corresponds to the
+ *  fraction of SPAM emails misclassified as HAM, and type 2 error corresponds to the fraction
+ *  of HAM emails misclassified as SPAM
+ */
+ErrorPair evaluate_filter_performance(const DirPath& test_dir, const Model& model, double zeta, ScoringMode mode,
+    size_t num_threads)
+{
+    size_t total_bytes_saved = 0;
+    size_t num_truncated = 0;
+
+    // classify emails from test_dir
+    FileList test_files = get_files_in_folder(test_dir);
+    std::vector<size_t> bytes_saved;
+    std::vector<char> truncated;
+    std::vector<Classification> classify_results = classify_files(test_files, model, zeta, mode, num_threads,
+        bytes_saved, truncated);
+
+    // measure performance
+    PerformanceMatrix perf_mat = get_performance_matrix(test_files, classify_results);
+    for (size_t i = 0; i < test_files.size(); ++i)
+    {
+        total_bytes_saved += bytes_saved[i];
+        num_truncated += truncated[i];
+    }
+
+    // print result
+    print_performance(perf_mat);
+    if (mode == ScoringMode::EARLY_EXIT)
+        std::cout << "Early exit left " << total_bytes_saved << " bytes unread" << std::endl;
+    if (mode == ScoringMode::STREAMING)
+        std::cout << num_truncated << " emails were longer than " << MAX_EMAIL_BYTES << " bytes" << std::endl;
+
+    return get_errors(perf_mat);
+}
+
+/**
+ * counts how the emails of each class were classified
+ *
+ * @param files : paths of the emails, whose names give their labels; see get_email_label()
+ * @param classify_results : classification of each email, in the order of files
+ * @return performance matrix, see PerformanceMatrix
+ */
+PerformanceMatrix get_performance_matrix(const FileList& files, const std::vector<Classification>& classify_results)
+{
+    // performance evaluation matrix:
+    // [ #(SPAM|SPAM)   ;   #(HAM|SPAM)
+    //   #(SPAM|HAM)    ;   #(HAM|HAM) ], where
+    // #(SPAM|SPAM) is the number of emails which belong to SPAM class and were classified as SPAM
+    // #(HAM|SPAM) is the number of emails which belong to SPAM class and were classified as HAM
+    // #(SPAM|HAM) is the number of emails which belong to HAM class and were classified as SPAM
+    // #(HAM|HAM) is the number of emails which belong to HAM class and were classified as HAM
+    PerformanceMatrix perf_mat = Eigen::Matrix2i::Zero();
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        // populate performance matrix based on if classification result correctly
+        // matches the email's label
+        int true_idx = get_email_label(files[i]);           // SPAM = 0, HAM = 1
+        int classify_idx = classify_results[i].first;       // SPAM = 0, HAM = 1
+        perf_mat(true_idx, classify_idx) += 1;
+    }
+    return perf_mat;
+}
+
+/**
+ * prints how many emails of each class were classified correctly
+ *
+ * @param perf_mat : output of the get_performance_matrix() function
+ */
+void print_performance(const PerformanceMatrix& perf_mat)
+{
+    // get total number of spam and ham emails in the testing dataset
+    int total_spam = perf_mat(0,0) + perf_mat(0,1);
+    int total_ham = perf_mat(1,0) + perf_mat(1,1);
+
+    std::cout << "Correctly classified " << perf_mat.diagonal()(0) << " out of "
+        << total_spam << " spam emails, and " << perf_mat.diagonal()(1) << " out of "
+        << total_ham << " ham emails" << std::endl;
+}
+
+/**
+ * calculates the error rates of a classification
+ *
+ * @param perf_mat : output of the get_performance_matrix() function
+ * @return ErrorPair of [Type 1 error, Type 2 error]; see evaluate_filter_performance()
+ */
+ErrorPair get_errors(const PerformanceMatrix& perf_mat)
+{
+    double type_1_error = (double) perf_mat(0,1)/ (double) (perf_mat(0,0) + perf_mat(0,1));
+    double type_2_error = (double) perf_mat(1,0)/ (double) (perf_mat(1,0) + perf_mat(1,1));
+    return {type_1_error, type_2_error};
+}
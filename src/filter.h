@@ -0,0 +1,85 @@
+#ifndef CLASSIFIER_FILTER_H
+#define CLASSIFIER_FILTER_H
+
+#include "util.h"
+
+// no a priori reason for any incoming message to be spam rather than ham,
+// and thus this classifier considers both cases to have equal probabilities
+#define SPAM_PRIOR 0.5
+#define HAM_PRIOR (1 - SPAM_PRIOR)
+
+// number of words, furthest from being neutral, that are scored per email
+// when classifying in the SIGNIFICANT_WORDS mode
+#define NUM_SIGNIFICANT_WORDS 15
+
+// number of words read between two checks of whether the rest of an email can still
+// change its classification, when classifying in the EARLY_EXIT mode
+#define EARLY_EXIT_CHECK_INTERVAL 16
+
+// size of the chunks an email is read in, and the default number of bytes of an email
+// that are read at most, when classifying in the STREAMING mode
+#define STREAM_CHUNK_SIZE 4096
+#define MAX_EMAIL_BYTES (1 << 20)
+
+// number of terms added one after the other by get_pairwise_sum(), below which splitting them in
+// halves costs more than it saves in rounding
+#define PAIRWISE_SUM_BLOCK 8
+
+// first line of every model file written by save_model(), and of those written before
+// the priors were saved along with the counts
+#define MODEL_FILE_HEADER "bayesian-spam-filter model v2"
+#define MODEL_FILE_HEADER_V1 "bayesian-spam-filter model v1"
+
+/**** type definitions ****/
+
+// a word of an email rated while selecting the most significant ones, with its terms for both classes
+struct SignificantWord
+{
+    Prob log_ratio;                                         // |ln P(w_i|SPAM) - ln P(w_i|HAM)|
+    const FreqDict::value_type* word;                       // the word and f_(w_i)
+    ProbPair log_prob;                                      // [ln P(w_i|SPAM), ln P(w_i|HAM)]
+    std::array<bool, 2> seen;                               // whether the word was seen in either class
+};
+
+/**** function prototypes ****/
+Model learn_distributions(const FileListPair&, const ProbPair& prior_by_category = {SPAM_PRIOR, HAM_PRIOR},
+    size_t num_threads = 1);
+void add_email_to_counts(TrainingCounts&, const FreqDict&, const EmailClass&);
+void remove_email_from_counts(TrainingCounts&, const FreqDict&, const EmailClass&);
+void save_model(const FilePath&, const Model&);
+Model load_model(const FilePath&);
+Classification classify_new_email(const FilePath&, const Model&, double zeta = 1.0);
+Classification classify_new_email_buffer(const char*, size_t, const Model&, double zeta = 1.0);
+Classification classify_new_email_significant(const FilePath&, const Model&,
+    size_t num_words = NUM_SIGNIFICANT_WORDS, double zeta = 1.0, size_t max_bytes = MAX_EMAIL_BYTES);
+Classification classify_new_email_early_exit(const FilePath&, const Model&, const LogProbBounds&,
+    size_t& bytes_saved, double zeta = 1.0);
+Classification classify_new_email_streaming(const FilePath&, const Model&, bool& truncated,
+    size_t max_bytes = MAX_EMAIL_BYTES, double zeta = 1.0);
+LogProbBounds get_log_prob_bounds(const Model&);
+void add_word_to_scores(PartialScores&, const std::string&, const Model&);
+ProbPair get_partial_scores(const PartialScores&, const Model&);
+Classification classify_scores(const ProbPair&, double);
+Classification classify_word_freq(const FreqDict&, const Model&, double, const TrainingCounts* delta = nullptr);
+std::vector<SignificantWord> select_significant_words(const FreqDict&, const Model&, size_t);
+FreqDict get_significant_words(const FreqDict&, const Model&, size_t);
+Classification classify_significant_words(std::vector<SignificantWord>, const Model&, double);
+bool get_word_freq_given_class(const Model&, const std::string&, const EmailClass&, size_t&,
+    const TrainingCounts* delta = nullptr);
+Prob log_prob_word_given_class(const Model&, const std::string&, const EmailClass&,
+    const TrainingCounts* delta = nullptr);
+std::vector<const FreqDict::value_type*> get_sorted_words(const FreqDict&);
+Prob get_pairwise_sum(const Prob*, size_t);
+Prob prob_class_intrsct_words(const Model&, const FreqDict&, const EmailClass&,
+    const TrainingCounts* delta = nullptr);
+Prob prob_class_intrsct_words(const Model&, const FreqDict&, const std::vector<const FreqDict::value_type*>&,
+    const EmailClass&, const TrainingCounts* delta = nullptr);
+std::vector<Classification> classify_files(const FileList&, const Model&, double, ScoringMode, size_t,
+    std::vector<size_t>&, std::vector<char>&);
+ErrorPair evaluate_filter_performance(const DirPath&, const Model&,
+    double zeta = 1.0, ScoringMode mode = ScoringMode::FULL_SCAN, size_t num_threads = 1);
+PerformanceMatrix get_performance_matrix(const FileList&, const std::vector<Classification>&);
+void print_performance(const PerformanceMatrix&);
+ErrorPair get_errors(const PerformanceMatrix&);
+
+#endif //CLASSIFIER_FILTER_H
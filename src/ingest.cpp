@@ -0,0 +1,411 @@
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "ingest.h"
+#include "metrics.h"
+#include "trace.h"
+
+/**** type definitions ****/
+
+// stages of a file being read through io_uring; the stage of a request is kept in its user data
+enum IngestStage {OPENING = 0, READING = 1, CLOSING = 2};
+
+// a file being read through io_uring
+struct IngestSlot
+{
+    size_t file_index;
+    int fd = -1;
+    std::string contents;
+    size_t size = 0;                                        // number of bytes read so far
+};
+
+// submission and completion rings shared with the kernel
+struct IoUring
+{
+    int fd = -1;
+    io_uring_params params = {};
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0, cq_ring_size = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*) MAP_FAILED;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned num_unsubmitted = 0;
+};
+
+// tears a ring down once no request in flight can still write to the slots, however reading stops
+class IoUringDrain
+{
+public:
+    IoUringDrain(IoUring& ring, std::vector<IngestSlot>& slots, size_t& num_pending)
+        : ring(ring), slots(slots), num_pending(num_pending) {}
+    ~IoUringDrain();
+    IoUringDrain(const IoUringDrain&) = delete;
+    IoUringDrain& operator=(const IoUringDrain&) = delete;
+
+private:
+    IoUring& ring;
+    std::vector<IngestSlot>& slots;
+    size_t& num_pending;
+};
+
+/**** function prototypes ****/
+bool setup_io_uring(IoUring&, unsigned);
+void teardown_io_uring(IoUring&);
+io_uring_sqe* get_sqe(IoUring&);
+bool submit_and_wait(IoUring&, unsigned);
+
+/**** functions ****/
+
+/**
+ * reads whole files, many at once, and hands each one to a callback as soon as it was read.
+ * files are opened, read and closed through io_uring when the kernel supports it, and otherwise
+ * by a pool of pread workers
+ *
+ * @param files : paths of the files
+ * @param on_read : called once per file; with io_uring it is called from the calling thread,
+ *  and otherwise from any of the pread workers at once
+ * @param num_threads : number of pread workers, if io_uring cannot be used
+ * @return whether io_uring was used
+ */
+bool read_files(const FileList& files, const FileReadCallback& on_read, size_t num_threads)
+{
+    FileReadCallback counted_on_read = [&on_read](size_t i, std::string& contents, bool readable)
+    {
+        count_metric(BYTES_READ, contents.size());
+        on_read(i, contents, readable);
+    };
+
+    if (std::getenv(INGEST_NO_IO_URING_ENV) == nullptr && read_files_io_uring(files, counted_on_read))
+        return true;
+
+    read_files_pread(files, counted_on_read, num_threads);
+    return false;
+}
+
+/**
+ * reads whole files through io_uring: up to INGEST_MAX_IN_FLIGHT files are opened, read in as
+ * many reads as their size requires, and closed, with a single system call per round of
+ * completions
+ *
+ * @param files : paths of the files
+ * @param on_read : called from the calling thread once per file
+ * @return false if io_uring is not available, in which case no file was read
+ * @throws std::runtime_error if io_uring stops working while files are being read
+ */
+bool read_files_io_uring(const FileList& files, const FileReadCallback& on_read)
+{
+    IoUring ring;
+    if (!setup_io_uring(ring, 2 * INGEST_MAX_IN_FLIGHT))
+        return false;
+
+    std::vector<IngestSlot> slots(std::min<size_t>(INGEST_MAX_IN_FLIGHT, files.size()));
+    size_t next_file = 0;
+    size_t num_pending = 0;                                 // requests submitted and not completed yet
+    IoUringDrain drain(ring, slots, num_pending);
+
+    // request data holds the slot in its upper bits and the stage in its lowest two bits
+    auto submit_open = [&](size_t slot_index)
+    {
+        IngestSlot& slot = slots[slot_index];
+        slot.file_index = next_file++;
+        slot.fd = -1;
+        slot.size = 0;
+        slot.contents.clear();
+
+        io_uring_sqe* sqe = get_sqe(ring);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t) files[slot.file_index].c_str();
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = (slot_index << 2) | IngestStage::OPENING;
+        ++num_pending;
+    };
+    auto submit_read = [&](size_t slot_index)
+    {
+        IngestSlot& slot = slots[slot_index];
+        if (slot.size == slot.contents.size())
+            slot.contents.resize(std::max<size_t>(2 * slot.contents.size(), INGEST_READ_BYTES));
+
+        io_uring_sqe* sqe = get_sqe(ring);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = slot.fd;
+        sqe->addr = (uint64_t) (&slot.contents[0] + slot.size);
+        sqe->len = (uint32_t) std::min<size_t>(slot.contents.size() - slot.size, 1u << 30);
+        sqe->off = slot.size;
+        sqe->user_data = (slot_index << 2) | IngestStage::READING;
+        ++num_pending;
+    };
+    auto submit_close = [&](int fd)
+    {
+        io_uring_sqe* sqe = get_sqe(ring);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = IngestStage::CLOSING;
+        ++num_pending;
+    };
+    // hands the file of a slot to the callback, and reuses the slot for the next file
+    auto finish = [&](size_t slot_index, bool readable)
+    {
+        IngestSlot& slot = slots[slot_index];
+        if (slot.fd >= 0)
+            submit_close(slot.fd);
+        slot.fd = -1;
+
+        slot.contents.resize(readable ? slot.size : 0);
+        on_read(slot.file_index, slot.contents, readable);
+        if (next_file < files.size())
+            submit_open(slot_index);
+    };
+
+    for (size_t i = 0; i < slots.size(); ++i)
+        submit_open(i);
+
+    while (num_pending > 0)
+    {
+        // requests in flight point into the slots; drain waits for them if this throws
+        if (!submit_and_wait(ring, 1))
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+            size_t slot_index = cqe.user_data >> 2;
+            int stage = (int) (cqe.user_data & 3);
+            int result = cqe.res;
+            --num_pending;
+
+            // the completion is consumed before new requests may reuse its slot in the ring
+            __atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+
+            if (stage == IngestStage::CLOSING)
+                continue;
+            if (result < 0)
+                finish(slot_index, false);
+            else if (stage == IngestStage::OPENING)
+            {
+                // the buffer fits the file and the read that reports its end, unless it grew since
+                IngestSlot& slot = slots[slot_index];
+                struct stat status;
+                slot.fd = result;
+                if (fstat(slot.fd, &status) == 0 && status.st_size >= 0)
+                    slot.contents.resize((size_t) status.st_size + 1);
+                submit_read(slot_index);
+            }
+            else if (result == 0)
+                finish(slot_index, true);
+            else
+            {
+                // read until end of file, as reads may return fewer bytes than asked for
+                slots[slot_index].size += (size_t) result;
+                submit_read(slot_index);
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * waits for the requests still in flight when reading stopped early, closes the files they left
+ * open, and tears the ring down. if the ring cannot be waited on any more, the slots are left
+ * allocated for good rather than freed under the kernel's feet
+ */
+IoUringDrain::~IoUringDrain()
+{
+    while (num_pending > 0 && submit_and_wait(ring, 1))
+    {
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+            if ((cqe.user_data & 3) == IngestStage::OPENING && cqe.res >= 0)
+                slots[cqe.user_data >> 2].fd = cqe.res;
+            --num_pending;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (num_pending > 0)
+        new std::vector<IngestSlot>(std::move(slots));
+    for (IngestSlot& slot : slots)
+        if (slot.fd >= 0)
+            close(slot.fd);
+    teardown_io_uring(ring);
+}
+
+/**
+ * reads whole files with a pool of workers, each one opening, reading with pread and closing
+ * the next file left
+ *
+ * @param files : paths of the files
+ * @param on_read : called once per file, from any of the workers at once
+ * @param num_threads : number of workers
+ */
+void read_files_pread(const FileList& files, const FileReadCallback& on_read, size_t num_threads)
+{
+    std::atomic<size_t> next_file{0};
+
+    auto read_next_files = [&]()
+    {
+        std::string contents;
+        for (size_t i = next_file++; i < files.size(); i = next_file++)
+        {
+            bool readable = false;
+            contents.clear();
+
+            {
+                TraceSpan span("read");
+                int fd = open(files[i].c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat status;
+                if (fd >= 0 && fstat(fd, &status) == 0)
+                {
+                    // the size is only a hint; files are read until pread reports their end
+                    contents.resize(std::max<size_t>((size_t) status.st_size, 1));
+                    size_t size = 0;
+                    ssize_t num_read;
+                    while ((num_read = pread(fd, &contents[size], contents.size() - size, (off_t) size)) != 0)
+                    {
+                        if (num_read < 0 && errno == EINTR)
+                            continue;
+                        if (num_read < 0)
+                            break;
+                        size += (size_t) num_read;
+                        if (size == contents.size())
+                            contents.resize(2 * contents.size());
+                    }
+                    readable = (num_read == 0);
+                    contents.resize(readable ? size : 0);
+                }
+                if (fd >= 0)
+                    close(fd);
+            }
+
+            on_read(i, contents, readable);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < num_threads; ++i)
+        workers.emplace_back(read_next_files);
+    read_next_files();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+/**
+ * sets up an io_uring instance and maps its rings
+ *
+ * @return false if the kernel does not support io_uring, or forbids it
+ */
+bool setup_io_uring(IoUring& ring, unsigned num_entries)
+{
+    ring.fd = (int) syscall(__NR_io_uring_setup, num_entries, &ring.params);
+    if (ring.fd < 0)
+        return false;
+
+    // openat, read and close requests need kernel 5.6, which reports IORING_FEAT_RW_CUR_POS; both
+    // rings are mapped at once since kernel 5.4
+    if (!(ring.params.features & IORING_FEAT_SINGLE_MMAP) || !(ring.params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        close(ring.fd);
+        return false;
+    }
+
+    ring.sq_ring_size = ring.params.sq_off.array + ring.params.sq_entries * sizeof(unsigned);
+    ring.cq_ring_size = ring.params.cq_off.cqes + ring.params.cq_entries * sizeof(io_uring_cqe);
+    ring.sq_ring_size = ring.cq_ring_size = std::max(ring.sq_ring_size, ring.cq_ring_size);
+
+    ring.sq_ring = mmap(nullptr, ring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring.fd, IORING_OFF_SQ_RING);
+    ring.cq_ring = ring.sq_ring;
+    ring.sqes = (io_uring_sqe*) mmap(nullptr, ring.params.sq_entries * sizeof(io_uring_sqe),
+                                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sq_ring == MAP_FAILED || ring.sqes == (io_uring_sqe*) MAP_FAILED)
+    {
+        teardown_io_uring(ring);
+        return false;
+    }
+
+    char* sq = (char*) ring.sq_ring;
+    char* cq = (char*) ring.cq_ring;
+    ring.sq_head = (unsigned*) (sq + ring.params.sq_off.head);
+    ring.sq_tail = (unsigned*) (sq + ring.params.sq_off.tail);
+    ring.sq_mask = (unsigned*) (sq + ring.params.sq_off.ring_mask);
+    ring.sq_array = (unsigned*) (sq + ring.params.sq_off.array);
+    ring.cq_head = (unsigned*) (cq + ring.params.cq_off.head);
+    ring.cq_tail = (unsigned*) (cq + ring.params.cq_off.tail);
+    ring.cq_mask = (unsigned*) (cq + ring.params.cq_off.ring_mask);
+    ring.cqes = (io_uring_cqe*) (cq + ring.params.cq_off.cqes);
+    return true;
+}
+
+void teardown_io_uring(IoUring& ring)
+{
+    if (ring.sqes != (io_uring_sqe*) MAP_FAILED)
+        munmap(ring.sqes, ring.params.sq_entries * sizeof(io_uring_sqe));
+    if (ring.sq_ring != MAP_FAILED)
+        munmap(ring.sq_ring, ring.sq_ring_size);
+    if (ring.fd >= 0)
+        close(ring.fd);
+    ring.fd = -1;
+}
+
+/**
+ * takes the next free submission queue entry; there are always enough, since every file has
+ * at most one request and one close in flight, and the queue holds twice INGEST_MAX_IN_FLIGHT
+ */
+io_uring_sqe* get_sqe(IoUring& ring)
+{
+    unsigned tail = *ring.sq_tail + ring.num_unsubmitted;
+    unsigned index = tail & *ring.sq_mask;
+    io_uring_sqe* sqe = &ring.sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[index] = index;
+    ++ring.num_unsubmitted;
+    return sqe;
+}
+
+/**
+ * submits the queued requests, and waits until at least min_complete requests completed
+ *
+ * @return false if io_uring_enter failed
+ */
+bool submit_and_wait(IoUring& ring, unsigned min_complete)
+{
+    TraceSpan span("io_uring_wait");
+    __atomic_store_n(ring.sq_tail, *ring.sq_tail + ring.num_unsubmitted, __ATOMIC_RELEASE);
+    ring.num_unsubmitted = 0;
+
+    while (true)
+    {
+        // requests the kernel did not take yet, after an interruption for example, are submitted again
+        unsigned to_submit = *ring.sq_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+        long result = syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete, IORING_ENTER_GETEVENTS,
+                              nullptr, 0);
+        if (result >= 0 && (unsigned) result == to_submit)
+            return true;
+        if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return false;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef CLASSIFIER_INGEST_H
+#define CLASSIFIER_INGEST_H
+
+#include <functional>
+#include <string>
+#include "util.h"
+
+// maximum number of files being opened, read or closed at once
+#define INGEST_MAX_IN_FLIGHT 64
+
+// size of the first read of a file whose size is unknown; the buffer doubles whenever a read fills it
+#define INGEST_READ_BYTES (64 << 10)
+
+// environment variable which, when set, makes read_files() use its pread workers instead of io_uring
+#define INGEST_NO_IO_URING_ENV "SPAMFILTER_NO_IO_URING"
+
+/**** type definitions ****/
+
+// called once per file with its index in the file list, its contents, and whether it could be read;
+// the contents may be moved away
+typedef std::function<void(size_t, std::string&, bool)> FileReadCallback;
+
+/**** function prototypes ****/
+bool read_files(const FileList&, const FileReadCallback&, size_t num_threads = 1);
+bool read_files_io_uring(const FileList&, const FileReadCallback&);
+void read_files_pread(const FileList&, const FileReadCallback&, size_t);
+
+#endif //CLASSIFIER_INGEST_H
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "filter.h"
+#include "memory_report.h"
+
+/**** function prototypes ****/
+void print_dict_memory(const std::string&, const DictMemory&, std::ostream&);
+
+/**** functions ****/
+
+/**
+ * estimates how much heap an allocation takes, including malloc's header and padding
+ *
+ * @param size : number of bytes requested
+ * @return number of bytes taken
+ */
+size_t get_allocation_size(size_t size)
+{
+    size_t chunk = (size + MEMORY_MALLOC_OVERHEAD + MEMORY_MALLOC_ALIGNMENT - 1) / MEMORY_MALLOC_ALIGNMENT
+        * MEMORY_MALLOC_ALIGNMENT;
+    return std::max<size_t>(chunk, MEMORY_MALLOC_MIN_CHUNK);
+}
+
+/**
+ * estimates the heap usage of a dictionary of word frequencies, entry by entry
+ *
+ * @param word_freq : the dictionary
+ * @return its heap usage, broken down
+ */
+DictMemory get_dict_memory(const FreqDict& word_freq)
+{
+    // a node holds the next pointer, the entry and the cached hash of its key
+    size_t node_size = get_allocation_size(sizeof(void*) + sizeof(FreqDict::value_type) + sizeof(size_t));
+    std::string empty;
+
+    DictMemory memory;
+    memory.num_entries = word_freq.size();
+    memory.num_buckets = word_freq.bucket_count();
+    for (const auto& word : word_freq)
+    {
+        // short strings are kept inside the std::string object itself
+        memory.key_bytes += sizeof(std::string);
+        if (word.first.capacity() > empty.capacity())
+            memory.key_bytes += get_allocation_size(word.first.capacity() + 1);
+    }
+    memory.value_bytes = memory.num_entries * sizeof(size_t);
+    memory.node_overhead_bytes = memory.num_entries * (node_size - sizeof(FreqDict::value_type));
+    memory.bucket_bytes = get_allocation_size(memory.num_buckets * sizeof(void*));
+    return memory;
+}
+
+/**
+ * projects the heap usage of a dictionary of word frequencies to another number of words, whose
+ * keys are as long on average as those of a measured dictionary
+ *
+ * @param measured : heap usage of the measured dictionary, from get_dict_memory()
+ * @param num_entries : number of words to project for
+ * @return projected heap usage; with a maximum load factor of 1, there are about as many buckets as words
+ */
+DictMemory project_dict_memory(const DictMemory& measured, size_t num_entries)
+{
+    DictMemory projected;
+    if (measured.num_entries == 0)
+        return projected;
+
+    double scale = (double) num_entries / (double) measured.num_entries;
+    projected.num_entries = num_entries;
+    projected.num_buckets = num_entries;
+    projected.key_bytes = (size_t) ((double) measured.key_bytes * scale);
+    projected.value_bytes = num_entries * sizeof(size_t);
+    projected.node_overhead_bytes = (size_t) ((double) measured.node_overhead_bytes * scale);
+    projected.bucket_bytes = get_allocation_size(num_entries * sizeof(void*));
+    return projected;
+}
+
+/**
+ * gets the largest resident set size of the process since it started, or since reset_peak_rss()
+ *
+ * @return the peak resident set size in bytes, or 0 if /proc/self/status cannot be read
+ */
+size_t get_peak_rss()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stoul(line.substr(6)) * 1024;
+    return 0;
+}
+
+/**
+ * resets the peak resident set size to the current one, so that the peak of the next phase can be measured
+ *
+ * @return false if the kernel does not allow it, in which case peaks stay those since the process started
+ */
+bool reset_peak_rss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.flush();
+    return (bool) clear_refs;
+}
+
+/**
+ * prints the heap usage of a dictionary, broken down
+ */
+void print_dict_memory(const std::string& name, const DictMemory& memory, std::ostream& out)
+{
+    out << std::left << std::setw(24) << name << std::right
+        << std::setw(10) << memory.num_entries << std::setw(10) << memory.num_buckets
+        << std::setw(14) << memory.key_bytes << std::setw(14) << memory.value_bytes
+        << std::setw(14) << memory.node_overhead_bytes << std::setw(14) << memory.bucket_bytes
+        << std::setw(14) << memory.get_total_bytes() << "\n";
+}
+
+/**
+ * reports where memory goes when training on labeled emails and classifying test emails: the peak
+ * resident set size of each phase, the heap usage of each class's word counts and of the largest
+ * per-email scratch space, and the heap usage projected for larger vocabularies
+ *
+ * @param training_files : FileListPair of [spam emails, ham emails] to learn from
+ * @param test_files : emails to be classified
+ * @param vocabulary_sizes : numbers of words per class to project the heap usage of the model for
+ * @param out : stream the report is written to
+ */
+void report_memory(const FileListPair& training_files, const FileList& test_files,
+    const std::vector<size_t>& vocabulary_sizes, std::ostream& out)
+{
+    bool can_reset = reset_peak_rss();
+    Model model = learn_distributions(training_files);
+    size_t train_peak = get_peak_rss();
+
+    // the scratch space of an email is its contents, its word counts, and while it is scored, its
+    // words sorted and one term per word for each of two sums
+    reset_peak_rss();
+    size_t max_scratch = 0, max_distinct = 0, max_bytes = 0;
+    FilePath max_scratch_email;
+    std::string contents;
+    for (const FilePath& email : test_files)
+    {
+        if (!read_file(email, contents))
+            continue;
+        FreqDict word_freq = get_word_freq_in_buffer(contents.data(), contents.size());
+        classify_word_freq(word_freq, model, 1.0);
+
+        size_t scratch = get_allocation_size(contents.capacity()) + get_dict_memory(word_freq).get_total_bytes()
+            + get_allocation_size(word_freq.size() * sizeof(void*)) + 2 * get_allocation_size(word_freq.size() * sizeof(Prob));
+        if (scratch > max_scratch)
+        {
+            max_scratch = scratch;
+            max_scratch_email = email;
+        }
+        max_distinct = std::max(max_distinct, word_freq.size());
+        max_bytes = std::max(max_bytes, contents.size());
+    }
+    size_t classify_peak = get_peak_rss();
+
+    out << "Peak resident set size" << (can_reset ? "" : " (since the process started)") << ":\n"
+        << "  training on " << training_files[0].size() + training_files[1].size() << " emails: " << train_peak << " bytes\n"
+        << "  classifying " << test_files.size() << " emails: " << classify_peak << " bytes\n\n";
+
+    DictMemory spam_memory = get_dict_memory(model.freq_by_category[EmailClass::SPAM]);
+    DictMemory ham_memory = get_dict_memory(model.freq_by_category[EmailClass::HAM]);
+    DictMemory model_memory;
+    for (const DictMemory* memory : {&spam_memory, &ham_memory})
+    {
+        model_memory.num_entries += memory->num_entries;
+        model_memory.num_buckets += memory->num_buckets;
+        model_memory.key_bytes += memory->key_bytes;
+        model_memory.value_bytes += memory->value_bytes;
+        model_memory.node_overhead_bytes += memory->node_overhead_bytes;
+        model_memory.bucket_bytes += memory->bucket_bytes;
+    }
+
+    out << "Heap usage of the model, in bytes:\n" << std::left << std::setw(24) << "" << std::right
+        << std::setw(10) << "words" << std::setw(10) << "buckets" << std::setw(14) << "keys" << std::setw(14) << "values"
+        << std::setw(14) << "nodes" << std::setw(14) << "bucket array" << std::setw(14) << "total" << "\n";
+    print_dict_memory("spam counts", spam_memory, out);
+    print_dict_memory("ham counts", ham_memory, out);
+    print_dict_memory("model", model_memory, out);
+    if (model_memory.num_entries > 0)
+        out << std::fixed << std::setprecision(1) << "  " << (double) model_memory.get_total_bytes() / (double) model_memory.num_entries
+            << " bytes per word, of which " << (double) (model_memory.value_bytes) / (double) model_memory.num_entries
+            << " hold its count\n" << std::defaultfloat;
+
+    out << "\nLargest per-email scratch space: " << max_scratch << " bytes, for " << max_scratch_email << "\n"
+        << "  largest email: " << max_bytes << " bytes; most distinct words in an email: " << max_distinct << "\n";
+
+    out << "\nProjected heap usage of the word counts of one class, in bytes:\n";
+    for (size_t vocabulary_size : vocabulary_sizes)
+        print_dict_memory(std::to_string(vocabulary_size) + " words", project_dict_memory(model_memory, vocabulary_size), out);
+    out.flush();
+}
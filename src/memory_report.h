@@ -0,0 +1,42 @@
+#ifndef CLASSIFIER_MEMORY_REPORT_H
+#define CLASSIFIER_MEMORY_REPORT_H
+
+#include <iostream>
+#include <vector>
+#include "util.h"
+
+// allocation granularity, per-allocation header and smallest allocation of the C library's malloc
+// (glibc on 64-bit targets), with which the heap size of every allocation is estimated
+#define MEMORY_MALLOC_ALIGNMENT 16
+#define MEMORY_MALLOC_OVERHEAD 8
+#define MEMORY_MALLOC_MIN_CHUNK 32
+
+// vocabulary sizes model memory is projected for, when none are given
+#define MEMORY_DEFAULT_PROJECTIONS {100000, 1000000, 10000000}
+
+/**** type definitions ****/
+
+// estimated heap usage of a dictionary of word frequencies, as laid out by libstdc++: one node
+// per entry holding a pointer to the next node, the entry and its cached hash, and an array of
+// bucket pointers
+struct DictMemory
+{
+    size_t num_entries = 0;
+    size_t num_buckets = 0;
+    size_t key_bytes = 0;                                   // std::string objects, and their characters when too long to fit in them
+    size_t value_bytes = 0;
+    size_t node_overhead_bytes = 0;                         // next pointers, cached hashes, and malloc headers and padding
+    size_t bucket_bytes = 0;
+
+    size_t get_total_bytes() const { return key_bytes + value_bytes + node_overhead_bytes + bucket_bytes; }
+};
+
+/**** function prototypes ****/
+size_t get_allocation_size(size_t);
+DictMemory get_dict_memory(const FreqDict&);
+DictMemory project_dict_memory(const DictMemory&, size_t);
+size_t get_peak_rss();
+bool reset_peak_rss();
+void report_memory(const FileListPair&, const FileList&, const std::vector<size_t>&, std::ostream&);
+
+#endif //CLASSIFIER_MEMORY_REPORT_H
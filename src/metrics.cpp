@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "metrics.h"
+
+/**** type definitions ****/
+
+// metrics of one thread. only the thread itself writes them, with plain relaxed loads and stores
+// rather than atomic read-modify-writes, so that counting never contends between threads; they
+// are atomic only so that get_metrics() may read them at any time
+struct ThreadMetrics
+{
+    std::array<std::atomic<uint64_t>, NUM_METRIC_COUNTERS> counters = {};
+    std::array<std::atomic<uint64_t>, NUM_METRIC_PHASES> phase_ns = {};
+    std::array<std::atomic<uint64_t>, NUM_METRIC_PHASES> phase_calls = {};
+
+    ThreadMetrics();
+    ~ThreadMetrics();
+};
+
+/**** global variables ****/
+std::atomic<bool> metrics_enabled{false};
+
+// metrics of the running threads, and totals of those of the threads that exited
+static std::mutex metrics_mutex;
+static std::vector<ThreadMetrics*> thread_metrics_list;
+static MetricValues exited_thread_metrics;
+
+// file named by METRICS_FILE_ENV
+static FilePath metrics_file;
+
+// names of the counters and phases, as exported
+static const char* counter_names[NUM_METRIC_COUNTERS] = {"files_enumerated", "bytes_read", "texts_tokenized",
+    "tokens_scanned", "distinct_tokens", "model_hits", "model_misses", "model_probes"};
+static const char* phase_names[NUM_METRIC_PHASES] = {"scan", "read", "tokenize", "train", "score"};
+
+/**** function prototypes ****/
+ThreadMetrics& get_thread_metrics();
+void add_relaxed(std::atomic<uint64_t>&, uint64_t);
+void save_metrics_at_exit();
+
+/**** functions ****/
+
+ThreadMetrics::ThreadMetrics()
+{
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    thread_metrics_list.push_back(this);
+}
+
+/**
+ * keeps the metrics of an exiting thread in the totals
+ */
+ThreadMetrics::~ThreadMetrics()
+{
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    for (size_t i = 0; i < NUM_METRIC_COUNTERS; ++i)
+        exited_thread_metrics.counters[i] += counters[i].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < NUM_METRIC_PHASES; ++i)
+    {
+        exited_thread_metrics.phase_ns[i] += phase_ns[i].load(std::memory_order_relaxed);
+        exited_thread_metrics.phase_calls[i] += phase_calls[i].load(std::memory_order_relaxed);
+    }
+    thread_metrics_list.erase(std::find(thread_metrics_list.begin(), thread_metrics_list.end(), this));
+}
+
+PhaseTimer::PhaseTimer(MetricPhase phase) : phase(phase), running(metrics_enabled.load(std::memory_order_relaxed))
+{
+    if (running)
+        start = std::chrono::steady_clock::now();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (running)
+        add_phase_time(phase, (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * gets the metrics of the calling thread, which are registered the first time it counts anything
+ */
+ThreadMetrics& get_thread_metrics()
+{
+    thread_local ThreadMetrics thread_metrics;
+    return thread_metrics;
+}
+
+/**
+ * adds to a value only the calling thread writes
+ */
+void add_relaxed(std::atomic<uint64_t>& value, uint64_t amount)
+{
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/**
+ * increases a counter of the calling thread; use count_metric(), which first checks whether metrics are kept
+ *
+ * @param counter : counter to be increased
+ * @param amount : amount to increase it by
+ */
+void add_to_metric(MetricCounter counter, uint64_t amount)
+{
+    add_relaxed(get_thread_metrics().counters[counter], amount);
+}
+
+/**
+ * adds one run of a phase to the calling thread's metrics
+ *
+ * @param phase : phase that ran
+ * @param ns : how long it ran, in nanoseconds
+ */
+void add_phase_time(MetricPhase phase, uint64_t ns)
+{
+    ThreadMetrics& thread_metrics = get_thread_metrics();
+    add_relaxed(thread_metrics.phase_ns[phase], ns);
+    add_relaxed(thread_metrics.phase_calls[phase], 1);
+}
+
+/**
+ * starts or stops keeping metrics; metrics kept so far are not reset
+ *
+ * @param enabled : whether metrics are kept from now on
+ */
+void set_metrics_enabled(bool enabled)
+{
+    metrics_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * starts keeping metrics if METRICS_FILE_ENV names a file, and then writes them there when the
+ * program exits
+ *
+ * @return whether metrics are kept
+ */
+bool enable_metrics_from_environment()
+{
+    const char* path = std::getenv(METRICS_FILE_ENV);
+    if (path == nullptr || *path == '\0')
+        return false;
+
+    bool first_time = metrics_file.empty();
+    metrics_file = path;
+    set_metrics_enabled(true);
+    if (first_time)
+        std::atexit(save_metrics_at_exit);
+    return true;
+}
+
+/**
+ * totals the metrics of every thread, running or exited
+ *
+ * @return the totals
+ */
+MetricValues get_metrics()
+{
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    MetricValues values = exited_thread_metrics;
+    for (const ThreadMetrics* thread_metrics : thread_metrics_list)
+    {
+        for (size_t i = 0; i < NUM_METRIC_COUNTERS; ++i)
+            values.counters[i] += thread_metrics->counters[i].load(std::memory_order_relaxed);
+        for (size_t i = 0; i < NUM_METRIC_PHASES; ++i)
+        {
+            values.phase_ns[i] += thread_metrics->phase_ns[i].load(std::memory_order_relaxed);
+            values.phase_calls[i] += thread_metrics->phase_calls[i].load(std::memory_order_relaxed);
+        }
+    }
+    return values;
+}
+
+/**
+ * writes metrics as a JSON object: {"counters": {name: value, ...}, "phases": {name: {"seconds": s, "calls": n}, ...}}
+ *
+ * @param values : metrics, from get_metrics()
+ * @return the JSON text
+ */
+std::string metrics_to_json(const MetricValues& values)
+{
+    std::ostringstream json;
+    json << "{\n  \"counters\": {";
+    for (size_t i = 0; i < NUM_METRIC_COUNTERS; ++i)
+        json << (i > 0 ? "," : "") << "\n    \"" << counter_names[i] << "\": " << values.counters[i];
+    json << "\n  },\n  \"phases\": {";
+    for (size_t i = 0; i < NUM_METRIC_PHASES; ++i)
+        json << (i > 0 ? "," : "") << "\n    \"" << phase_names[i] << "\": {\"seconds\": "
+             << (double) values.phase_ns[i] / 1e9 << ", \"calls\": " << values.phase_calls[i] << "}";
+    json << "\n  }\n}\n";
+    return json.str();
+}
+
+/**
+ * writes metrics in the Prometheus text exposition format, every counter as spamfilter_<name>_total
+ * and the phases as spamfilter_phase_seconds_total and spamfilter_phase_calls_total, labeled by phase
+ *
+ * @param values : metrics, from get_metrics()
+ * @return the Prometheus text
+ */
+std::string metrics_to_prometheus(const MetricValues& values)
+{
+    std::ostringstream text;
+    for (size_t i = 0; i < NUM_METRIC_COUNTERS; ++i)
+        text << "# TYPE spamfilter_" << counter_names[i] << "_total counter\n"
+             << "spamfilter_" << counter_names[i] << "_total " << values.counters[i] << "\n";
+
+    text << "# TYPE spamfilter_phase_seconds_total counter\n";
+    for (size_t i = 0; i < NUM_METRIC_PHASES; ++i)
+        text << "spamfilter_phase_seconds_total{phase=\"" << phase_names[i] << "\"} "
+             << (double) values.phase_ns[i] / 1e9 << "\n";
+    text << "# TYPE spamfilter_phase_calls_total counter\n";
+    for (size_t i = 0; i < NUM_METRIC_PHASES; ++i)
+        text << "spamfilter_phase_calls_total{phase=\"" << phase_names[i] << "\"} " << values.phase_calls[i] << "\n";
+    return text.str();
+}
+
+/**
+ * writes the current metrics to the file named by METRICS_FILE_ENV, replacing it at once so that a
+ * reader never sees half of it
+ *
+ * @return whether the metrics were written
+ */
+bool save_metrics()
+{
+    if (metrics_file.empty())
+        return false;
+
+    MetricValues values = get_metrics();
+    bool prometheus = metrics_file.size() >= 5 && metrics_file.compare(metrics_file.size() - 5, 5, ".prom") == 0;
+    FilePath temp_file = metrics_file + ".tmp";
+    {
+        std::ofstream file(temp_file);
+        file << (prometheus ? metrics_to_prometheus(values) : metrics_to_json(values));
+        if (!file)
+            return false;
+    }
+    return std::rename(temp_file.c_str(), metrics_file.c_str()) == 0;
+}
+
+/**
+ * writes the metrics when the program exits, once every thread_local ThreadMetrics of the main thread was totaled
+ */
+void save_metrics_at_exit()
+{
+    save_metrics();
+}
+
+/**
+ * counts the entries of a dictionary compared with words while looking them up: those of the
+ * bucket of each word up to the word itself, or the whole bucket if the word is not there
+ *
+ * @param word_freq : dictionary the words are looked up in
+ * @param words : words looked up
+ * @return number of entries compared
+ */
+uint64_t get_num_probes(const FreqDict& word_freq, const FreqDict& words)
+{
+    uint64_t num_probes = 0;
+    for (const auto& word : words)
+    {
+        size_t bucket = word_freq.bucket(word.first);
+        for (auto entry = word_freq.begin(bucket); entry != word_freq.end(bucket); ++entry)
+        {
+            ++num_probes;
+            if (entry->first == word.first)
+                break;
+        }
+    }
+    return num_probes;
+}
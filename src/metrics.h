@@ -0,0 +1,93 @@
+#ifndef CLASSIFIER_METRICS_H
+#define CLASSIFIER_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "util.h"
+
+// environment variable naming the file metrics are written to when the program exits, as
+// Prometheus text if its name ends with .prom and as JSON otherwise; metrics are only kept when set
+#define METRICS_FILE_ENV "SPAMFILTER_METRICS"
+
+/**** type definitions ****/
+
+// counted events
+enum MetricCounter
+{
+    FILES_ENUMERATED = 0,                                   // files listed by a DirectoryScanner
+    BYTES_READ,                                             // bytes of emails read from files
+    TEXTS_TOKENIZED,                                        // emails, or byte ranges of large emails, split into words
+    TOKENS_SCANNED,                                         // words found in them
+    DISTINCT_TOKENS,                                        // distinct words of each of them, summed
+    MODEL_HITS,                                             // scored words the model was trained on
+    MODEL_MISSES,                                           // scored words it never saw
+    MODEL_PROBES,                                           // entries of the model's hash buckets compared while scoring
+    NUM_METRIC_COUNTERS
+};
+
+// timed phases; a phase running inside another one is timed in both
+enum MetricPhase
+{
+    SCAN_PHASE = 0,                                         // get_files_in_folder()
+    READ_PHASE,                                             // read_file()
+    TOKENIZE_PHASE,                                         // get_word_freq_in_buffer(), get_words_in_file()
+    TRAIN_PHASE,                                            // learn_distributions()
+    SCORE_PHASE,                                            // prob_class_intrsct_words()
+    NUM_METRIC_PHASES
+};
+
+// totals of every counter and phase, over all threads
+struct MetricValues
+{
+    std::array<uint64_t, NUM_METRIC_COUNTERS> counters = {};
+    std::array<uint64_t, NUM_METRIC_PHASES> phase_ns = {};  // time spent in each phase, summed over threads
+    std::array<uint64_t, NUM_METRIC_PHASES> phase_calls = {};
+};
+
+// whether metrics are kept; when they are not, counting and timing cost one relaxed load and a branch
+extern std::atomic<bool> metrics_enabled;
+
+/**
+ * times a phase from its construction to its destruction, if metrics are kept
+ */
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(MetricPhase phase);
+    ~PhaseTimer();
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    MetricPhase phase;
+    bool running;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**** function prototypes ****/
+void add_to_metric(MetricCounter, uint64_t);
+void add_phase_time(MetricPhase, uint64_t);
+void set_metrics_enabled(bool);
+bool enable_metrics_from_environment();
+MetricValues get_metrics();
+std::string metrics_to_json(const MetricValues&);
+std::string metrics_to_prometheus(const MetricValues&);
+bool save_metrics();
+uint64_t get_num_probes(const FreqDict&, const FreqDict&);
+
+/**
+ * counts an event, if metrics are kept
+ *
+ * @param counter : counter to be increased
+ * @param amount : amount to increase it by
+ */
+inline void count_metric(MetricCounter counter, uint64_t amount = 1)
+{
+    if (metrics_enabled.load(std::memory_order_relaxed))
+        add_to_metric(counter, amount);
+}
+
+#endif //CLASSIFIER_METRICS_H
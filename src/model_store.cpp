@@ -0,0 +1,87 @@
+#include "filter.h"
+#include "model_store.h"
+
+/**** functions ****/
+
+/**
+ * adds an email labeled by a user to the user's counts; the counts are copied, updated and
+ * swapped in, so that the shared model is never copied and readers never wait for the update
+ *
+ * @param store : the shared model and the users' counts
+ * @param user : the user who labeled the email
+ * @param email_word_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param email_class : label of the email
+ */
+void add_user_email(ModelStore& store, const std::string& user, const FreqDict& email_word_freq,
+    const EmailClass& email_class)
+{
+    std::shared_ptr<const TrainingCounts> delta;
+    {
+        std::lock_guard<std::mutex> lock(store.mutex);
+        auto it = store.delta_by_user.find(user);
+        if (it != store.delta_by_user.end())
+            delta = it->second;
+    }
+
+    // the copy is made outside the lock; concurrent updates of the same user are serialized below
+    auto new_delta = delta ? std::make_shared<TrainingCounts>(*delta) : std::make_shared<TrainingCounts>();
+    add_email_to_counts(*new_delta, email_word_freq, email_class);
+
+    std::lock_guard<std::mutex> lock(store.mutex);
+    std::shared_ptr<const TrainingCounts>& current = store.delta_by_user[user];
+    if (current != delta)
+    {
+        // another email of the user was added meanwhile; apply this one on top of it
+        new_delta = current ? std::make_shared<TrainingCounts>(*current) : std::make_shared<TrainingCounts>();
+        add_email_to_counts(*new_delta, email_word_freq, email_class);
+    }
+    current = new_delta;
+}
+
+/**
+ * forgets the emails labeled by a user; the user's emails are then classified with the shared model
+ *
+ * @param store : the shared model and the users' counts
+ * @param user : the user to be forgotten
+ */
+void remove_user(ModelStore& store, const std::string& user)
+{
+    std::lock_guard<std::mutex> lock(store.mutex);
+    store.delta_by_user.erase(user);
+}
+
+/**
+ * @param store : the shared model and the users' counts
+ * @return number of users who labeled at least one email
+ */
+size_t get_num_users(const ModelStore& store)
+{
+    std::lock_guard<std::mutex> lock(store.mutex);
+    return store.delta_by_user.size();
+}
+
+/**
+ * classifies an email held in memory for a user, as if the shared model had also been trained
+ * on the emails the user labeled; both are looked up in a single pass over the email's words
+ *
+ * @param store : the shared model and the users' counts
+ * @param user : the user the email is classified for; users without labeled emails get the shared model
+ * @param data : bytes of the email
+ * @param size : number of bytes of the email
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_user_email(const ModelStore& store, const std::string& user, const char* data,
+    size_t size, double zeta)
+{
+    std::shared_ptr<const TrainingCounts> delta;
+    {
+        std::lock_guard<std::mutex> lock(store.mutex);
+        auto it = store.delta_by_user.find(user);
+        if (it != store.delta_by_user.end())
+            delta = it->second;
+    }
+
+    FreqDict word_freq = get_word_freq_in_buffer(data, size);
+    return classify_word_freq(word_freq, *store.base, zeta, delta.get());
+}
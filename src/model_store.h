@@ -0,0 +1,28 @@
+#ifndef CLASSIFIER_MODEL_STORE_H
+#define CLASSIFIER_MODEL_STORE_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "util.h"
+
+/**** type definitions ****/
+
+// a shared model, and the emails each user labeled on top of it. the model and the users'
+// counts are never modified once published: adding an email to a user's counts replaces
+// them as a whole, so classifications in progress keep a consistent view
+struct ModelStore
+{
+    std::shared_ptr<const Model> base;
+    std::unordered_map<std::string, std::shared_ptr<const TrainingCounts>> delta_by_user;
+    mutable std::mutex mutex;                               // guards delta_by_user
+};
+
+/**** function prototypes ****/
+void add_user_email(ModelStore&, const std::string&, const FreqDict&, const EmailClass&);
+void remove_user(ModelStore&, const std::string&);
+size_t get_num_users(const ModelStore&);
+Classification classify_user_email(const ModelStore&, const std::string&, const char*, size_t, double zeta = 1.0);
+
+#endif //CLASSIFIER_MODEL_STORE_H
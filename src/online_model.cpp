@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <stdexcept>
+#include "filter.h"
+#include "online_model.h"
+
+/**** function prototypes ****/
+void swap_snapshot(OnlineModel&, const ModelSnapshot*);
+
+/**** functions ****/
+
+/**
+ * frees every snapshot; no thread may be reading the model anymore
+ */
+OnlineModel::~OnlineModel()
+{
+    for (const auto& retired_snapshot : retired)
+        delete retired_snapshot.second;
+    delete snapshot.load();
+}
+
+/**
+ * replaces the model being read, for example with one reloaded from a file; the emails learned
+ * with learn_emails() since the previous model was published are dropped
+ *
+ * @param online_model : the model being read
+ * @param model : the new model
+ */
+void publish_model(OnlineModel& online_model, const Model& model)
+{
+    std::lock_guard<std::mutex> lock(online_model.writer_mutex);
+
+    const ModelSnapshot* current = online_model.snapshot.load(std::memory_order_acquire);
+    swap_snapshot(online_model, new ModelSnapshot{std::make_shared<const Model>(model), TrainingCounts(),
+                                                  current != nullptr ? current->version + 1 : 1});
+}
+
+/**
+ * learns labeled emails and publishes a snapshot including them; readers that enter a snapshot
+ * after this returns classify with them, while those already reading finish with the previous
+ * snapshot. the learned counts are kept apart from the base model until ONLINE_MAX_DELTA_EMAILS
+ * emails were learned, and are then folded into a new base model; either way, the copy is made
+ * here and never slows readers down
+ *
+ * @param online_model : the model being read; publish_model() must have been called first
+ * @param emails : word frequencies and labels of the emails to be learned
+ * @return version of the published snapshot
+ */
+size_t learn_emails(OnlineModel& online_model, const std::vector<std::pair<FreqDict, EmailClass>>& emails)
+{
+    std::lock_guard<std::mutex> lock(online_model.writer_mutex);
+
+    const ModelSnapshot* current = online_model.snapshot.load(std::memory_order_acquire);
+    auto next = new ModelSnapshot{current->base, current->delta, current->version + 1};
+    for (const auto& email : emails)
+        add_email_to_counts(next->delta, email.first, email.second);
+
+    if (next->delta.num_emails_by_category[0] + next->delta.num_emails_by_category[1] >= ONLINE_MAX_DELTA_EMAILS)
+    {
+        auto base = std::make_shared<Model>(*next->base);
+        for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+        {
+            for (const auto& word : next->delta.freq_by_category[c])
+                base->freq_by_category[c][word.first] += word.second;
+            base->num_emails_by_category[c] += next->delta.num_emails_by_category[c];
+        }
+        next->base = base;
+        next->delta = TrainingCounts();
+    }
+
+    swap_snapshot(online_model, next);
+    return next->version;
+}
+
+/**
+ * publishes a snapshot, retires the previous one, and frees the retired snapshots that no
+ * reader can hold anymore; the writer mutex must be held
+ *
+ * @param online_model : the model being read
+ * @param next : the snapshot to be published
+ */
+void swap_snapshot(OnlineModel& online_model, const ModelSnapshot* next)
+{
+    const ModelSnapshot* previous = online_model.snapshot.exchange(next, std::memory_order_seq_cst);
+
+    // readers that announce this epoch or a later one load the pointer after the exchange above
+    // and cannot see the previous snapshot
+    uint64_t retire_epoch = online_model.epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    if (previous != nullptr)
+        online_model.retired.emplace_back(retire_epoch, previous);
+
+    uint64_t oldest_epoch = UINT64_MAX;
+    size_t num_readers = std::min<size_t>(online_model.num_readers.load(), ONLINE_MAX_READERS);
+    for (size_t reader = 0; reader < num_readers; ++reader)
+    {
+        uint64_t reader_epoch = online_model.reader_epochs[reader].load(std::memory_order_seq_cst);
+        if (reader_epoch != 0)
+            oldest_epoch = std::min(oldest_epoch, reader_epoch);
+    }
+
+    auto freed = std::remove_if(online_model.retired.begin(), online_model.retired.end(),
+        [oldest_epoch](const std::pair<uint64_t, const ModelSnapshot*>& retired_snapshot)
+        {
+            if (retired_snapshot.first > oldest_epoch)
+                return false;
+            delete retired_snapshot.second;
+            return true;
+        });
+    online_model.retired.erase(freed, online_model.retired.end());
+}
+
+/**
+ * reserves a reader slot for the calling thread; a slot must not be used by two threads at once
+ *
+ * @param online_model : the model to be read
+ * @return the reader slot, to be passed to enter_snapshot() and leave_snapshot()
+ */
+size_t register_reader(OnlineModel& online_model)
+{
+    size_t reader = online_model.num_readers.fetch_add(1);
+    if (reader >= ONLINE_MAX_READERS)
+        throw std::runtime_error("too many readers of an online model");
+    return reader;
+}
+
+/**
+ * starts reading the current snapshot, without locking; it stays valid until leave_snapshot()
+ *
+ * @param online_model : the model being read
+ * @param reader : slot returned by register_reader()
+ * @return the current snapshot
+ */
+const ModelSnapshot* enter_snapshot(OnlineModel& online_model, size_t reader)
+{
+    online_model.reader_epochs[reader].store(online_model.epoch.load(std::memory_order_seq_cst),
+                                             std::memory_order_seq_cst);
+    return online_model.snapshot.load(std::memory_order_seq_cst);
+}
+
+/**
+ * stops reading the snapshot returned by the last enter_snapshot() with the same reader slot
+ *
+ * @param online_model : the model being read
+ * @param reader : slot returned by register_reader()
+ */
+void leave_snapshot(OnlineModel& online_model, size_t reader)
+{
+    online_model.reader_epochs[reader].store(0, std::memory_order_release);
+}
+
+/**
+ * classifies an email with a snapshot, as if its base model had also been trained on the
+ * emails learned since it was published
+ *
+ * @param snapshot : snapshot returned by enter_snapshot()
+ * @param word_freq : dictionary whose keys are email words and values are f_(w_i)
+ * @param zeta : decision factor; see classify_new_email()
+ * @return classification result for the given email; see classify_new_email()
+ */
+Classification classify_snapshot(const ModelSnapshot& snapshot, const FreqDict& word_freq, double zeta)
+{
+    return classify_word_freq(word_freq, *snapshot.base, zeta, &snapshot.delta);
+}
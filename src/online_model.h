@@ -0,0 +1,54 @@
+#ifndef CLASSIFIER_ONLINE_MODEL_H
+#define CLASSIFIER_ONLINE_MODEL_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "util.h"
+
+// maximum number of threads that can read an online model
+#define ONLINE_MAX_READERS 256
+
+// number of learned emails after which they are folded into a new base model, so that
+// publishing a snapshot only copies a bounded number of counts
+#define ONLINE_MAX_DELTA_EMAILS 1024
+
+/**** type definitions ****/
+
+// what readers of an online model see: a base model, the emails learned since it was
+// published, and a version that grows with every published snapshot
+struct ModelSnapshot
+{
+    std::shared_ptr<const Model> base;
+    TrainingCounts delta;
+    size_t version;
+};
+
+// a model that learns while it is read. a single writer at a time publishes immutable
+// snapshots; readers never lock, they announce the epoch they read in and a snapshot is
+// only freed once no reader can still hold it (epoch-based reclamation)
+struct OnlineModel
+{
+    std::atomic<const ModelSnapshot*> snapshot{nullptr};
+    std::atomic<uint64_t> epoch{1};
+    std::array<std::atomic<uint64_t>, ONLINE_MAX_READERS> reader_epochs{};    // 0 while not reading
+    std::atomic<size_t> num_readers{0};
+
+    std::mutex writer_mutex;                                // guards the members below
+    std::vector<std::pair<uint64_t, const ModelSnapshot*>> retired;            // epoch retired in, snapshot
+
+    ~OnlineModel();
+};
+
+/**** function prototypes ****/
+void publish_model(OnlineModel&, const Model&);
+size_t learn_emails(OnlineModel&, const std::vector<std::pair<FreqDict, EmailClass>>&);
+size_t register_reader(OnlineModel&);
+const ModelSnapshot* enter_snapshot(OnlineModel&, size_t);
+void leave_snapshot(OnlineModel&, size_t);
+Classification classify_snapshot(const ModelSnapshot&, const FreqDict&, double zeta = 1.0);
+
+#endif //CLASSIFIER_ONLINE_MODEL_H
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+#include "parameter_search.h"
+#include "scheduler.h"
+#include "trace.h"
+
+/**** functions ****/
+
+/**
+ * evaluates every combination of smoothing, prior and decision factor by cross-validation over
+ * cached emails. the emails are never tokenized again and the models of the folds are never
+ * trained again: for every fold and smoothing, [ln P(w_i|Class)] is derived once for the whole
+ * vocabulary from the counts, and the terms of the scores of the fold's emails are summed once.
+ * priors and decision factors then only move the decision between the two scores, which costs
+ * a comparison per email. at smoothing 1, the scores are those of classify_new_email(), bit for bit
+ *
+ * @param cache : cache holding every email of file_lists_by_category
+ * @param file_lists_by_category : a two-element array of the spam and ham files
+ * @param folds : fold of every email, from assign_folds()
+ * @param num_folds : number of folds
+ * @param smoothings : values of α, all above 0
+ * @param spam_priors : values of P(SPAM), all strictly between 0 and 1; P(HAM) = 1 - P(SPAM)
+ * @param zetas : values of the decision factor; see classify_new_email()
+ * @param num_threads : number of threads; more than one score folds, and count decisions, on a TaskScheduler
+ * @return one result per combination, for every smoothing, every prior, and every zeta in turn
+ */
+std::vector<SearchResult> search_parameters(const CorpusCache& cache, const FileListPair& file_lists_by_category,
+    const std::vector<size_t>& folds, size_t num_folds, const std::vector<Prob>& smoothings,
+    const std::vector<Prob>& spam_priors, const std::vector<double>& zetas, size_t num_threads)
+{
+    TraceSpan span("search_parameters");
+    for (Prob smoothing : smoothings)
+        if (!(smoothing > 0))
+            throw std::invalid_argument("smoothing must be above 0");
+    for (Prob spam_prior : spam_priors)
+        if (!(spam_prior > 0 && spam_prior < 1))
+            throw std::invalid_argument("spam prior must be between 0 and 1");
+
+    CachedModel model = learn_cached_distributions(cache, file_lists_by_category);
+    std::vector<const TokenCounts*> emails;
+    std::vector<EmailClass> labels;
+    for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+    {
+        for (const FilePath& file : file_lists_by_category[c])
+        {
+            emails.push_back(&get_cached_email(cache, file));
+            labels.push_back((EmailClass) c);
+        }
+    }
+
+    // terms of the score of every email in either class, for every smoothing, scored by the model
+    // of the email's fold; every email belongs to a single fold, so tasks write disjoint entries
+    std::vector<std::vector<std::array<ProbPair, 2>>> score_terms(smoothings.size(),
+        std::vector<std::array<ProbPair, 2>>(emails.size()));
+    auto score_fold = [&](size_t fold, size_t s)
+    {
+        TraceSpan fold_span("score_fold");
+        CachedModel fold_model = get_fold_model(cache, file_lists_by_category, folds, fold, model);
+        std::array<std::vector<Prob>, 2> log_probs;
+        for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+            get_smoothed_log_probs(fold_model, (EmailClass) c, smoothings[s], log_probs[c]);
+
+        for (size_t e = 0; e < emails.size(); ++e)
+            if (folds[e] == fold)
+                for (int c = EmailClass::SPAM; c <= EmailClass::HAM; ++c)
+                    score_terms[s][e][c] = get_smoothed_score_terms(*emails[e], fold_model, (EmailClass) c, log_probs[c]);
+    };
+
+    // every combination of prior and zeta, for a smoothing, decides from the same scores
+    std::vector<SearchResult> results(smoothings.size() * spam_priors.size() * zetas.size());
+    auto decide = [&](size_t s, size_t p)
+    {
+        ProbPair log_prior = {log(spam_priors[p]), log(1 - spam_priors[p])};
+        for (size_t z = 0; z < zetas.size(); ++z)
+        {
+            SearchResult& result = results[(s * spam_priors.size() + p) * zetas.size() + z];
+            result = {smoothings[s], spam_priors[p], zetas[z], Eigen::Matrix2i::Zero()};
+            for (size_t e = 0; e < emails.size(); ++e)
+            {
+                // summed as in prob_class_intrsct_words()
+                const std::array<ProbPair, 2>& terms = score_terms[s][e];
+                Prob spam_intrsct_words = (log_prior[0] + terms[0][0]) + terms[0][1];
+                Prob ham_intrsct_words = (log_prior[1] + terms[1][0]) + terms[1][1];
+                result.perf_mat(labels[e], spam_intrsct_words > zetas[z]*ham_intrsct_words ? EmailClass::SPAM : EmailClass::HAM) += 1;
+            }
+        }
+    };
+
+    if (num_threads > 1)
+    {
+        TaskScheduler scheduler(num_threads);
+        for (size_t fold = 0; fold < num_folds; ++fold)
+            for (size_t s = 0; s < smoothings.size(); ++s)
+                scheduler.submit([&score_fold, fold, s]() { score_fold(fold, s); });
+        scheduler.wait();
+
+        for (size_t s = 0; s < smoothings.size(); ++s)
+            for (size_t p = 0; p < spam_priors.size(); ++p)
+                scheduler.submit([&decide, s, p]() { decide(s, p); });
+        scheduler.wait();
+    }
+    else
+    {
+        for (size_t fold = 0; fold < num_folds; ++fold)
+            for (size_t s = 0; s < smoothings.size(); ++s)
+                score_fold(fold, s);
+        for (size_t s = 0; s < smoothings.size(); ++s)
+            for (size_t p = 0; p < spam_priors.size(); ++p)
+                decide(s, p);
+    }
+
+    return results;
+}
+
+/**
+ * derives [ln P(w_i|Class)] = ln((f_i + α) / (#(Class) + 2α)) for every word id at once, unseen
+ * words having f_i = 0; at α = 1 these are the values of log_prob_word_given_class()
+ *
+ * @param model : counts by word id, from learn_cached_distributions() or get_fold_model()
+ * @param email_class : the class (SPAM or HAM)
+ * @param smoothing : α
+ * @param log_probs : filled with [ln P(w_i|Class)] of every word id of the model
+ */
+void get_smoothed_log_probs(const CachedModel& model, const EmailClass& email_class, Prob smoothing,
+    std::vector<Prob>& log_probs)
+{
+    const IdFreqs& class_freq_by_id = model.freq_by_category[email_class];
+    Prob num_class_emails = (Prob) model.num_emails_by_category[email_class] + 2*smoothing;
+
+    log_probs.resize(class_freq_by_id.size());
+    for (size_t id = 0; id < class_freq_by_id.size(); ++id)
+        log_probs[id] = log(((Prob) class_freq_by_id[id] + smoothing)/ num_class_emails);
+}
+
+/**
+ * calculates the terms of [ln P(Email and Class)] of a cached email that the prior does not change,
+ * with the same terms, summed in the same order, as prob_class_intrsct_tokens()
+ *
+ * @param token_counts : (word id, frequency) pairs of the email, sorted by word
+ * @param model : counts by word id the email is scored with
+ * @param email_class : the class (SPAM or HAM)
+ * @param log_probs : [ln P(w_i|Class)] of every word id, from get_smoothed_log_probs()
+ * @return the multinomial term, and \sum f_(w_i)*[ln P(w_i|Class)]; [ln P(Email and Class)] is
+ *  [ln P(Class)] plus the first, plus the second
+ */
+ProbPair get_smoothed_score_terms(const TokenCounts& token_counts, const CachedModel& model,
+    const EmailClass& email_class, const std::vector<Prob>& log_probs)
+{
+    const IdFreqs& class_freq_by_id = model.freq_by_category[email_class];
+    long double num = 0.0;
+    std::vector<Prob> den_terms;
+    std::vector<Prob> prob_word_given_class_terms;
+
+    for (const TokenCount& token : token_counts)
+    {
+        if (class_freq_by_id[token.first] == 0)
+        {
+            prob_word_given_class_terms.push_back(log_probs[token.first]);
+            num += 1;
+        }
+        else
+        {
+            // log() gives a double, and so does its product with the frequency in prob_class_intrsct_words()
+            prob_word_given_class_terms.push_back((token.second)*(double) log_probs[token.first]);
+            num += token.second;
+            den_terms.push_back(lgamma(token.second + 1.0));
+        }
+    }
+    long double den = 1.0 + get_pairwise_sum(den_terms.data(), den_terms.size());
+
+    return {lgamma(num + 1.0) - den, get_pairwise_sum(prob_word_given_class_terms.data(), prob_word_given_class_terms.size())};
+}
+
+/**
+ * sorts results from the fewest misclassified emails to the most, and among equals from the
+ * fewest ham emails classified as spam, which cost the most; ties keep the order of the grid
+ *
+ * @param results : output of the search_parameters() function
+ */
+void sort_search_results(std::vector<SearchResult>& results)
+{
+    std::stable_sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b)
+    {
+        int a_errors = a.perf_mat(0,1) + a.perf_mat(1,0), b_errors = b.perf_mat(0,1) + b.perf_mat(1,0);
+        if (a_errors != b_errors)
+            return a_errors < b_errors;
+        return a.perf_mat(1,0) < b.perf_mat(1,0);
+    });
+}
+
+/**
+ * prints the best parameters found, and how the filter does with the parameters it uses
+ * (α = 1, P(SPAM) = SPAM_PRIOR, zeta = 0.88) if they were searched
+ *
+ * @param results : output of the search_parameters() function, sorted by sort_search_results()
+ * @param num_best : number of best results printed
+ * @param out : where the report is written
+ */
+void print_search_results(const std::vector<SearchResult>& results, size_t num_best, std::ostream& out)
+{
+    auto print_result = [&out](const SearchResult& result)
+    {
+        ErrorPair errors = get_errors(result.perf_mat);
+        out << "smoothing " << (double) result.smoothing << ", spam prior " << (double) result.spam_prior
+            << ", zeta " << result.zeta << std::fixed << std::setprecision(4) << ": type 1 error " << errors[0]
+            << ", type 2 error " << errors[1] << ", " << result.perf_mat(0,1) + result.perf_mat(1,0)
+            << " misclassified" << std::defaultfloat << std::setprecision(6) << "\n";
+    };
+
+    out << "Best " << std::min(num_best, results.size()) << " of " << results.size() << " parameters:\n";
+    for (size_t i = 0; i < std::min(num_best, results.size()); ++i)
+        print_result(results[i]);
+
+    for (const SearchResult& result : results)
+    {
+        if (result.smoothing == 1 && result.spam_prior == (Prob) SPAM_PRIOR && result.zeta == 0.88)
+        {
+            out << "Current parameters, ranked " << (&result - &results[0]) + 1 << ":\n";
+            print_result(result);
+        }
+    }
+    out.flush();
+}
+
+/**
+ * saves every result as CSV, one line per combination of parameters
+ *
+ * @param results_path : path of the file to be written
+ * @param results : output of the search_parameters() function
+ * @return whether the file was written
+ */
+bool save_search_results(const FilePath& results_path, const std::vector<SearchResult>& results)
+{
+    std::ofstream file(results_path);
+    file << "smoothing,spam_prior,zeta,type_1_error,type_2_error\n";
+    for (const SearchResult& result : results)
+    {
+        ErrorPair errors = get_errors(result.perf_mat);
+        file << (double) result.smoothing << "," << (double) result.spam_prior << "," << result.zeta << ","
+             << errors[0] << "," << errors[1] << "\n";
+    }
+    return (bool) file;
+}
@@ -0,0 +1,37 @@
+#ifndef CLASSIFIER_PARAMETER_SEARCH_H
+#define CLASSIFIER_PARAMETER_SEARCH_H
+
+#include <iostream>
+#include <vector>
+#include "cross_validation.h"
+
+// values searched by default for the smoothing α of P(w_i|Class) = (f_i + α) / (#(Class) + 2α),
+// the prior probability of SPAM, and the decision factor zeta
+#define SEARCH_DEFAULT_SMOOTHINGS {0.01, 0.03, 0.1, 0.3, 1.0, 3.0}
+#define SEARCH_DEFAULT_SPAM_PRIORS {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9}
+#define SEARCH_DEFAULT_ZETAS {0.70, 0.75, 0.80, 0.82, 0.84, 0.86, 0.88, 0.90, 0.92, 0.94, 0.96, 0.98, 1.00, 1.05, 1.10}
+
+// number of best parameters printed
+#define SEARCH_NUM_BEST 10
+
+/**** type definitions ****/
+
+// parameters of one point of the grid, and how the emails were classified with them
+struct SearchResult
+{
+    Prob smoothing;                                         // α; the filter itself uses 1
+    Prob spam_prior;
+    double zeta;
+    PerformanceMatrix perf_mat;                             // summed over the folds; see PerformanceMatrix
+};
+
+/**** function prototypes ****/
+std::vector<SearchResult> search_parameters(const CorpusCache&, const FileListPair&, const std::vector<size_t>&,
+    size_t, const std::vector<Prob>&, const std::vector<Prob>&, const std::vector<double>&, size_t num_threads = 1);
+void get_smoothed_log_probs(const CachedModel&, const EmailClass&, Prob, std::vector<Prob>&);
+ProbPair get_smoothed_score_terms(const TokenCounts&, const CachedModel&, const EmailClass&, const std::vector<Prob>&);
+void sort_search_results(std::vector<SearchResult>&);
+void print_search_results(const std::vector<SearchResult>&, size_t, std::ostream&);
+bool save_search_results(const FilePath&, const std::vector<SearchResult>&);
+
+#endif //CLASSIFIER_PARAMETER_SEARCH_H
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "plot.h"
+
+// size of the SVG canvas and margins around the plotting area, in pixels
+#define SVG_WIDTH 640
+#define SVG_HEIGHT 480
+#define SVG_MARGIN_LEFT 70
+#define SVG_MARGIN_RIGHT 20
+#define SVG_MARGIN_TOP 40
+#define SVG_MARGIN_BOTTOM 60
+#define SVG_NUM_TICKS 5
+
+/**** function prototypes ****/
+std::string format_tick(double);
+
+/**** functions ****/
+
+/**
+ * saves curves sharing the same x values as comma-separated values, one row per x value
+ *
+ * @param csv_path : path of the file to be written
+ * @param x : x values of the curves
+ * @param ys : y values of every curve; each must have as many values as x
+ * @param x_label : header of the x column
+ * @param labels : header of every y column
+ */
+void save_curves_csv(const FilePath& csv_path, const std::vector<double>& x, const std::vector<std::vector<double>>& ys,
+    const std::string& x_label, const std::vector<std::string>& labels)
+{
+    std::ofstream file(csv_path);
+    if (!file)
+        throw std::runtime_error("cannot write " + csv_path);
+
+    file << x_label;
+    for (const std::string& label : labels)
+        file << "," << label;
+    file << "\n" << std::setprecision(17);
+
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        file << x[i];
+        for (const std::vector<double>& y : ys)
+            file << "," << y[i];
+        file << "\n";
+    }
+}
+
+/**
+ * renders curves sharing the same x values as a self-contained SVG line plot, with axes,
+ * ticks, a title and a legend
+ *
+ * @param svg_path : path of the file to be written
+ * @param x : x values of the curves
+ * @param ys : y values of every curve; each must have as many values as x
+ * @param title : title of the plot
+ * @param labels : legend entry of every curve
+ * @param x_label : label of the x axis
+ * @param y_label : label of the y axis
+ */
+void save_curves_svg(const FilePath& svg_path, const std::vector<double>& x, const std::vector<std::vector<double>>& ys,
+    const std::string& title, const std::vector<std::string>& labels, const std::string& x_label,
+    const std::string& y_label)
+{
+    static const char* colors[] = {"#1f77b4", "#ff7f0e", "#2ca02c", "#d62728", "#9467bd"};
+
+    std::ofstream file(svg_path);
+    if (!file)
+        throw std::runtime_error("cannot write " + svg_path);
+
+    // data ranges, padded so that flat curves still get a non-empty range
+    double x_min = x.empty() ? 0.0 : *std::min_element(x.begin(), x.end());
+    double x_max = x.empty() ? 1.0 : *std::max_element(x.begin(), x.end());
+    double y_min = 0.0, y_max = 0.0;
+    for (const std::vector<double>& y : ys)
+        for (double v : y)
+            if (std::isfinite(v))
+            {
+                y_min = std::min(y_min, v);
+                y_max = std::max(y_max, v);
+            }
+    if (x_max <= x_min)
+        x_max = x_min + 1.0;
+    if (y_max <= y_min)
+        y_max = y_min + 1.0;
+
+    double plot_width = SVG_WIDTH - SVG_MARGIN_LEFT - SVG_MARGIN_RIGHT;
+    double plot_height = SVG_HEIGHT - SVG_MARGIN_TOP - SVG_MARGIN_BOTTOM;
+    auto px = [&](double v) { return SVG_MARGIN_LEFT + (v - x_min)/(x_max - x_min)*plot_width; };
+    auto py = [&](double v) { return SVG_MARGIN_TOP + (y_max - v)/(y_max - y_min)*plot_height; };
+
+    file << std::fixed << std::setprecision(2);
+    file << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << SVG_WIDTH << "\" height=\"" << SVG_HEIGHT
+         << "\" font-family=\"sans-serif\" font-size=\"12\">\n";
+    file << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+    file << "<text x=\"" << SVG_WIDTH/2 << "\" y=\"" << SVG_MARGIN_TOP/2 + 5
+         << "\" text-anchor=\"middle\" font-size=\"16\">" << title << "</text>\n";
+
+    // axes box, ticks and grid lines
+    file << "<rect x=\"" << SVG_MARGIN_LEFT << "\" y=\"" << SVG_MARGIN_TOP << "\" width=\"" << plot_width
+         << "\" height=\"" << plot_height << "\" fill=\"none\" stroke=\"black\"/>\n";
+    for (int i = 0; i <= SVG_NUM_TICKS; ++i)
+    {
+        double xv = x_min + (x_max - x_min)*i/SVG_NUM_TICKS;
+        double yv = y_min + (y_max - y_min)*i/SVG_NUM_TICKS;
+        file << "<line x1=\"" << px(xv) << "\" y1=\"" << SVG_MARGIN_TOP << "\" x2=\"" << px(xv) << "\" y2=\""
+             << SVG_MARGIN_TOP + plot_height << "\" stroke=\"#dddddd\"/>\n";
+        file << "<text x=\"" << px(xv) << "\" y=\"" << SVG_MARGIN_TOP + plot_height + 16
+             << "\" text-anchor=\"middle\">" << format_tick(xv) << "</text>\n";
+        file << "<line x1=\"" << SVG_MARGIN_LEFT << "\" y1=\"" << py(yv) << "\" x2=\"" << SVG_MARGIN_LEFT + plot_width
+             << "\" y2=\"" << py(yv) << "\" stroke=\"#dddddd\"/>\n";
+        file << "<text x=\"" << SVG_MARGIN_LEFT - 6 << "\" y=\"" << py(yv) + 4
+             << "\" text-anchor=\"end\">" << format_tick(yv) << "</text>\n";
+    }
+    file << "<text x=\"" << SVG_MARGIN_LEFT + plot_width/2 << "\" y=\"" << SVG_HEIGHT - 15
+         << "\" text-anchor=\"middle\">" << x_label << "</text>\n";
+    file << "<text transform=\"translate(18," << SVG_MARGIN_TOP + plot_height/2
+         << ") rotate(-90)\" text-anchor=\"middle\">" << y_label << "</text>\n";
+
+    // curves and legend
+    for (size_t c = 0; c < ys.size(); ++c)
+    {
+        const char* color = colors[c % (sizeof(colors)/sizeof(colors[0]))];
+
+        file << "<polyline fill=\"none\" stroke=\"" << color << "\" stroke-width=\"2\" points=\"";
+        for (size_t i = 0; i < x.size() && i < ys[c].size(); ++i)
+            if (std::isfinite(ys[c][i]))
+                file << px(x[i]) << "," << py(ys[c][i]) << " ";
+        file << "\"/>\n";
+
+        double legend_y = SVG_MARGIN_TOP + 15 + 18.0*c;
+        file << "<line x1=\"" << SVG_MARGIN_LEFT + plot_width - 130 << "\" y1=\"" << legend_y << "\" x2=\""
+             << SVG_MARGIN_LEFT + plot_width - 105 << "\" y2=\"" << legend_y << "\" stroke=\"" << color
+             << "\" stroke-width=\"2\"/>\n";
+        file << "<text x=\"" << SVG_MARGIN_LEFT + plot_width - 100 << "\" y=\"" << legend_y + 4 << "\">"
+             << (c < labels.size() ? labels[c] : "") << "</text>\n";
+    }
+
+    file << "</svg>\n";
+}
+
+/**
+ * formats an axis tick value with as few decimals as needed
+ *
+ * @param value : the tick value
+ * @return the value with at most three significant digits
+ */
+std::string format_tick(double value)
+{
+    std::ostringstream stream;
+    stream << std::setprecision(3) << (std::fabs(value) < 1e-12 ? 0.0 : value);
+    return stream.str();
+}
@@ -0,0 +1,14 @@
+#ifndef CLASSIFIER_PLOT_H
+#define CLASSIFIER_PLOT_H
+
+#include <string>
+#include <vector>
+#include "util.h"
+
+/**** function prototypes ****/
+void save_curves_csv(const FilePath&, const std::vector<double>&, const std::vector<std::vector<double>>&,
+    const std::string&, const std::vector<std::string>&);
+void save_curves_svg(const FilePath&, const std::vector<double>&, const std::vector<std::vector<double>>&,
+    const std::string&, const std::vector<std::string>&, const std::string&, const std::string&);
+
+#endif //CLASSIFIER_PLOT_H
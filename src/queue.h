@@ -0,0 +1,99 @@
+#ifndef CLASSIFIER_QUEUE_H
+#define CLASSIFIER_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+ * blocking multi-producer multi-consumer FIFO queue holding at most a fixed number of items;
+ * producers wait while it is full and consumers wait while it is empty, until it is closed
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    /**
+     * appends an item, waiting while the queue is full
+     *
+     * @return false if the queue was closed, in which case the item is dropped
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * removes the oldest item, waiting while the queue is empty
+     *
+     * @return false if the queue was closed and all its items were removed
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * removes up to max_items of the oldest items at once, waiting while the queue is empty;
+     * under load this hands consumers whole batches for the cost of a single wake-up
+     *
+     * @return number of items appended to batch; 0 if the queue was closed and is empty
+     */
+    size_t pop_batch(std::vector<T>& batch, size_t max_items)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+
+        size_t num_items = 0;
+        while (!items.empty() && num_items < max_items)
+        {
+            batch.push_back(std::move(items.front()));
+            items.pop_front();
+            ++num_items;
+        }
+        lock.unlock();
+        not_full.notify_all();
+        return num_items;
+    }
+
+    /**
+     * wakes up all waiting producers and consumers; items already queued can still be removed
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+#endif //CLASSIFIER_QUEUE_H
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstdint>
+#include "scheduler.h"
+#include "trace.h"
+
+// index of the worker run by the calling thread, or SIZE_MAX outside of workers
+static thread_local size_t current_worker = SIZE_MAX;
+static thread_local const TaskScheduler* current_scheduler = nullptr;
+
+/**** functions ****/
+
+TaskScheduler::TaskScheduler(size_t num_threads)
+{
+    num_threads = std::max<size_t>(num_threads, 1);
+    for (size_t i = 0; i < num_threads; ++i)
+        workers.emplace_back(new Worker);
+    for (size_t i = 0; i < num_threads; ++i)
+        threads.emplace_back(&TaskScheduler::run_worker, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    task_queued.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void TaskScheduler::submit(std::function<void()> task)
+{
+    size_t worker = (current_scheduler == this) ? current_worker : next_worker++ % workers.size();
+
+    num_unfinished.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+        workers[worker]->tasks.push_back(std::move(task));
+    }
+    num_queued.fetch_add(1);
+
+    // taking the lock orders this with a worker checking num_queued before going to sleep
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+    }
+    task_queued.notify_one();
+}
+
+void TaskScheduler::wait()
+{
+    wait_until_below(1);
+}
+
+void TaskScheduler::wait_until_below(size_t max_unfinished)
+{
+    std::unique_lock<std::mutex> lock(state_mutex);
+    all_done.wait(lock, [this, max_unfinished] { return num_unfinished.load() < max_unfinished; });
+}
+
+/**
+ * takes the newest task of a worker's own deque, or else steals the oldest task of another one
+ *
+ * @return false if every deque was empty
+ */
+bool TaskScheduler::take_task(size_t worker, std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+        if (!workers[worker]->tasks.empty())
+        {
+            task = std::move(workers[worker]->tasks.back());
+            workers[worker]->tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < workers.size(); ++i)
+    {
+        Worker& victim = *workers[(worker + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * runs tasks until the scheduler is destroyed, sleeping while there are none
+ */
+void TaskScheduler::run_worker(size_t worker)
+{
+    current_worker = worker;
+    current_scheduler = this;
+
+    std::function<void()> task;
+    while (true)
+    {
+        if (take_task(worker, task))
+        {
+            num_queued.fetch_sub(1);
+            task();
+            task = nullptr;
+
+            num_unfinished.fetch_sub(1);
+            {
+                std::lock_guard<std::mutex> lock(state_mutex);
+            }
+            all_done.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+        task_queued.wait(lock, [this] { return stopping || num_queued.load() > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+/**
+ * counts the words of an email held in memory on a scheduler, and hands their frequencies to a
+ * continuation. an email larger than SCHEDULER_SPLIT_BYTES is split into byte ranges counted by
+ * separate tasks, each counting the words that start in its range; the task finishing last merges
+ * the counts of all ranges, in order, and runs the continuation
+ *
+ * @param scheduler : the scheduler
+ * @param contents : the email; it is kept alive until its words are counted
+ * @param on_counted : continuation receiving the frequency of every word in the email
+ */
+void submit_word_freq_in_buffer(TaskScheduler& scheduler, std::shared_ptr<const std::string> contents,
+    std::function<void(FreqDict&)> on_counted)
+{
+    if (contents->size() <= SCHEDULER_SPLIT_BYTES)
+    {
+        scheduler.submit([contents, on_counted]()
+        {
+            FreqDict word_freq = get_word_freq_in_buffer(contents->data(), contents->size());
+            on_counted(word_freq);
+        });
+        return;
+    }
+
+    struct SplitEmail
+    {
+        std::vector<FreqDict> freq_by_range;
+        std::atomic<size_t> num_ranges_left;
+        std::function<void(FreqDict&)> on_counted;
+    };
+    size_t num_ranges = (contents->size() + SCHEDULER_SPLIT_BYTES - 1) / SCHEDULER_SPLIT_BYTES;
+    auto split_email = std::make_shared<SplitEmail>();
+    split_email->freq_by_range.resize(num_ranges);
+    split_email->num_ranges_left = num_ranges;
+    split_email->on_counted = std::move(on_counted);
+
+    for (size_t i = 0; i < num_ranges; ++i)
+    {
+        scheduler.submit([contents, split_email, i]()
+        {
+            split_email->freq_by_range[i] = get_word_freq_in_buffer_range(contents->data(), contents->size(),
+                                                                          i * SCHEDULER_SPLIT_BYTES,
+                                                                          (i + 1) * SCHEDULER_SPLIT_BYTES);
+            if (split_email->num_ranges_left.fetch_sub(1) != 1)
+                return;
+
+            TraceSpan span("merge");
+            FreqDict word_freq = std::move(split_email->freq_by_range[0]);
+            for (size_t j = 1; j < split_email->freq_by_range.size(); ++j)
+                for (const auto& word : split_email->freq_by_range[j])
+                    word_freq[word.first] += word.second;
+            split_email->on_counted(word_freq);
+        });
+    }
+}
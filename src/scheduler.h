@@ -0,0 +1,78 @@
+#ifndef CLASSIFIER_SCHEDULER_H
+#define CLASSIFIER_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "util.h"
+
+// emails larger than this are split into byte ranges of this size, processed as separate tasks
+#define SCHEDULER_SPLIT_BYTES (1 << 20)
+
+// maximum number of tasks queued or running before producers of tasks wait; bounds the number
+// of emails read and waiting to be tokenized
+#define SCHEDULER_MAX_UNFINISHED 256
+
+/**
+ * work-stealing task scheduler. every worker thread has its own deque of tasks: tasks submitted
+ * by a worker go to the back of its deque and it takes them back from there, while idle workers
+ * steal from the front of the others' deques, so that a few long tasks never leave cores idle
+ * behind them the way a static partition of the work does
+ */
+class TaskScheduler
+{
+public:
+    explicit TaskScheduler(size_t num_threads);
+    ~TaskScheduler();
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /**
+     * queues a task; may be called from any thread, including from a running task
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * waits until every submitted task, and every task they submitted, has run
+     */
+    void wait();
+
+    /**
+     * waits until fewer than max_unfinished tasks are queued or running; lets producers of tasks
+     * bound how far they get ahead of the workers
+     */
+    void wait_until_below(size_t max_unfinished);
+
+    size_t get_num_threads() const { return workers.size(); }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;                                   // guards tasks
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take_task(size_t, std::function<void()>&);
+    void run_worker(size_t);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next_worker{0};                    // where tasks submitted from outside go
+    std::atomic<size_t> num_queued{0};
+    std::atomic<size_t> num_unfinished{0};
+
+    std::mutex state_mutex;
+    std::condition_variable task_queued;
+    std::condition_variable all_done;
+    bool stopping = false;
+};
+
+/**** function prototypes ****/
+void submit_word_freq_in_buffer(TaskScheduler&, std::shared_ptr<const std::string>, std::function<void(FreqDict&)>);
+
+#endif //CLASSIFIER_SCHEDULER_H
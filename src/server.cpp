@@ -0,0 +1,409 @@
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "filter.h"
+#include "metrics.h"
+#include "online_model.h"
+#include "queue.h"
+#include "server.h"
+
+/**** type definitions ****/
+
+// an email waiting to be classified, and where to hand its classification to
+struct ClassifyJob
+{
+    std::string email;
+    std::promise<Classification> result;
+};
+
+// an email reported as spam or ham, and where to hand the version of the model that learned it to
+struct ReportJob
+{
+    std::string email;
+    EmailClass email_class;
+    std::promise<size_t> version;
+};
+
+// state shared by the listening, connection, worker and signal threads
+struct ServerState
+{
+    OnlineModel model;
+    BoundedQueue<ClassifyJob> jobs{SERVER_QUEUE_CAPACITY};
+    BoundedQueue<ReportJob> reports{SERVER_QUEUE_CAPACITY};
+    double zeta;
+    std::atomic<bool> stopping{false};                      // set once SIGINT or SIGTERM is received
+
+    std::mutex connections_mutex;
+    std::condition_variable connections_done;
+    std::set<int> connections;                              // sockets of open connections
+};
+
+/**** function prototypes ****/
+void serve_connection(ServerState&, int);
+void classify_jobs(ServerState&, size_t);
+void learn_reports(ServerState&);
+bool read_fully(int, void*, size_t);
+bool write_fully(int, const void*, size_t);
+
+/**** functions ****/
+
+/**
+ * serves classifications over a Unix domain socket until SIGINT or SIGTERM is received. every
+ * request is a 4-byte big-endian length followed by that many bytes of an email; every response
+ * is a line "SPAM|HAM <ln P(SPAM|Email)> <ln P(HAM|Email)>". requests are queued for a pool of
+ * workers, which take them in batches of up to SERVER_BATCH_SIZE. a request whose length has its
+ * top bit set reports an email instead: its first byte is 's' for spam or 'h' for ham, followed by
+ * the email, and it is answered with "OK <version>" once the model including it is published. on
+ * SIGHUP, the model file is reloaded and swapped in, dropping the reported emails; either way,
+ * requests already taken by a worker finish with the snapshot they started with, and no request
+ * is dropped. on SIGUSR1, metrics are written to the file named by METRICS_FILE_ENV, if set
+ *
+ * @param model_path : path of a model file written by save_model()
+ * @param socket_path : path of the Unix domain socket to listen on
+ * @param zeta : decision factor; see classify_new_email()
+ * @param num_workers : number of worker threads classifying emails
+ * @return exit status of the server
+ */
+int serve_classifications(const FilePath& model_path, const std::string& socket_path, double zeta,
+    size_t num_workers)
+{
+    ServerState state;
+    state.zeta = zeta;
+
+    // load the model before accepting any request
+    try
+    {
+        publish_model(state.model, load_model(model_path));
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << "cannot load model: " << error.what() << std::endl;
+        return 1;
+    }
+
+    // signals are only received by the signal thread, and broken connections are reported by write()
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "socket path too long: " << socket_path << std::endl;
+        return 1;
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd < 0 || bind(listen_fd, (sockaddr*) &address, sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        std::cerr << "cannot listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min<size_t>(std::max<size_t>(num_workers, 1), ONLINE_MAX_READERS); ++i)
+        workers.emplace_back(classify_jobs, std::ref(state), register_reader(state.model));
+    std::thread learner(learn_reports, std::ref(state));
+
+    // reload the model on SIGHUP, write metrics on SIGUSR1, and stop listening on SIGINT or SIGTERM
+    std::thread signal_thread([&]()
+    {
+        int signal_number = 0;
+        while (sigwait(&signals, &signal_number) == 0 && (signal_number == SIGHUP || signal_number == SIGUSR1))
+        {
+            if (signal_number == SIGUSR1)
+            {
+                if (!save_metrics())
+                    std::cerr << "no metrics written; set " << METRICS_FILE_ENV << " to keep them" << std::endl;
+                continue;
+            }
+
+            try
+            {
+                publish_model(state.model, load_model(model_path));
+                std::cerr << "reloaded model " << model_path << " (version "
+                          << state.model.snapshot.load()->version << ")" << std::endl;
+            }
+            catch (const std::exception& error)
+            {
+                std::cerr << "keeping the current model: " << error.what() << std::endl;
+            }
+        }
+        state.stopping = true;
+        shutdown(listen_fd, SHUT_RDWR);
+    });
+
+    std::cerr << "serving " << model_path << " on " << socket_path << " with " << workers.size()
+              << " workers" << std::endl;
+
+    // running out of descriptors or memory only delays the next connection: accept() is retried,
+    // waiting longer after every failure, until the signal thread shuts the socket down
+    int status = 0;
+    std::chrono::milliseconds backoff(0);
+    while (!state.stopping)
+    {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0)
+        {
+            backoff = std::chrono::milliseconds(0);
+            std::lock_guard<std::mutex> lock(state.connections_mutex);
+            state.connections.insert(fd);
+            std::thread(serve_connection, std::ref(state), fd).detach();
+        }
+        else if (state.stopping || errno == EINTR || errno == ECONNABORTED)
+            continue;
+        else if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+        {
+            if (backoff.count() == 0)
+                std::cerr << "cannot accept connections: " << std::strerror(errno) << "; retrying" << std::endl;
+            backoff = std::min(std::max(2*backoff, std::chrono::milliseconds(SERVER_ACCEPT_MIN_BACKOFF_MS)),
+                               std::chrono::milliseconds(SERVER_ACCEPT_MAX_BACKOFF_MS));
+            std::this_thread::sleep_for(backoff);
+        }
+        else
+        {
+            std::cerr << "cannot accept connections: " << std::strerror(errno) << std::endl;
+            status = 1;
+            break;
+        }
+    }
+
+    // wake the signal thread up, unless it is the one that stopped the loop
+    pthread_kill(signal_thread.native_handle(), SIGTERM);
+    signal_thread.join();
+    close(listen_fd);
+    unlink(socket_path.c_str());
+
+    // let every connection finish the request it is serving, then stop the workers
+    {
+        std::unique_lock<std::mutex> lock(state.connections_mutex);
+        for (int connection : state.connections)
+            shutdown(connection, SHUT_RD);
+        state.connections_done.wait(lock, [&state] { return state.connections.empty(); });
+    }
+    state.jobs.close();
+    state.reports.close();
+    for (std::thread& worker : workers)
+        worker.join();
+    learner.join();
+
+    std::cerr << "stopped serving on " << socket_path << std::endl;
+    return status;
+}
+
+/**
+ * reads requests from a connection and writes their responses back, in order, until the
+ * client closes it or sends an invalid request. a request that could not be classified or
+ * learned is answered with "ERROR" and a reason, and the connection goes on
+ *
+ * @param state : state of the server
+ * @param fd : socket of the connection
+ */
+void serve_connection(ServerState& state, int fd)
+{
+    uint32_t length;
+    while (read_fully(fd, &length, sizeof(length)))
+    {
+        length = ntohl(length);
+        bool is_report = (length & SERVER_REPORT_FLAG) != 0;
+        length &= ~SERVER_REPORT_FLAG;
+        if (length > SERVER_MAX_REQUEST_BYTES)
+        {
+            const char error[] = "ERROR email too large\n";
+            write_fully(fd, error, sizeof(error) - 1);
+            break;
+        }
+
+        if (is_report)
+        {
+            char label = 0;
+            ReportJob report;
+            if (length == 0 || !read_fully(fd, &label, 1))
+                break;
+            report.email.resize(length - 1);
+            if (!read_fully(fd, &report.email[0], length - 1))
+                break;
+            if (label != 's' && label != 'h')
+            {
+                const char error[] = "ERROR unknown label\n";
+                write_fully(fd, error, sizeof(error) - 1);
+                break;
+            }
+            report.email_class = (label == 's') ? EmailClass::SPAM : EmailClass::HAM;
+
+            std::future<size_t> version = report.version.get_future();
+            if (!state.reports.push(std::move(report)))
+                break;
+
+            std::string line;
+            try
+            {
+                line = "OK " + std::to_string(version.get()) + "\n";
+            }
+            catch (const std::exception& error)
+            {
+                line = std::string("ERROR ") + error.what() + "\n";
+            }
+            if (!write_fully(fd, line.data(), line.size()))
+                break;
+            continue;
+        }
+
+        ClassifyJob job;
+        job.email.resize(length);
+        if (!read_fully(fd, &job.email[0], length))
+            break;
+
+        std::future<Classification> result = job.result.get_future();
+        if (!state.jobs.push(std::move(job)))
+            break;
+        std::ostringstream response;
+        response.precision(17);
+        try
+        {
+            Classification classify_result = result.get();
+            response << (classify_result.first == EmailClass::SPAM ? "SPAM " : "HAM ")
+                     << classify_result.second[0] << " " << classify_result.second[1] << "\n";
+        }
+        catch (const std::exception& error)
+        {
+            response << "ERROR " << error.what() << "\n";
+        }
+        std::string line = response.str();
+        if (!write_fully(fd, line.data(), line.size()))
+            break;
+    }
+
+    close(fd);
+    std::lock_guard<std::mutex> lock(state.connections_mutex);
+    state.connections.erase(fd);
+    state.connections_done.notify_all();
+}
+
+/**
+ * classifies queued emails in batches, with the snapshot of the model that is current when a
+ * batch is taken, until the queue is closed
+ *
+ * @param state : state of the server
+ * @param reader : reader slot of the calling thread; see register_reader()
+ */
+void classify_jobs(ServerState& state, size_t reader)
+{
+    std::vector<ClassifyJob> batch;
+    while (state.jobs.pop_batch(batch, SERVER_BATCH_SIZE) > 0)
+    {
+        const ModelSnapshot* snapshot = enter_snapshot(state.model, reader);
+        for (ClassifyJob& job : batch)
+        {
+            // an email that cannot be classified fails its own request only
+            try
+            {
+                FreqDict word_freq = get_word_freq_in_buffer(job.email.data(), job.email.size());
+                job.result.set_value(classify_snapshot(*snapshot, word_freq, state.zeta));
+            }
+            catch (...)
+            {
+                job.result.set_exception(std::current_exception());
+            }
+        }
+        leave_snapshot(state.model, reader);
+        batch.clear();
+    }
+}
+
+/**
+ * learns the reported emails, all the reports queued at once in a single snapshot, until the
+ * queue is closed; this is the only thread updating the model besides reloads
+ *
+ * @param state : state of the server
+ */
+void learn_reports(ServerState& state)
+{
+    std::vector<ReportJob> batch;
+    while (state.reports.pop_batch(batch, SERVER_QUEUE_CAPACITY) > 0)
+    {
+        try
+        {
+            std::vector<std::pair<FreqDict, EmailClass>> emails;
+            for (const ReportJob& report : batch)
+                emails.emplace_back(get_word_freq_in_buffer(report.email.data(), report.email.size()), report.email_class);
+
+            size_t version = learn_emails(state.model, emails);
+            for (ReportJob& report : batch)
+                report.version.set_value(version);
+        }
+        catch (...)
+        {
+            // none of the batch was published; learn_emails() only swaps a complete snapshot in
+            for (ReportJob& report : batch)
+                report.version.set_exception(std::current_exception());
+        }
+        batch.clear();
+    }
+}
+
+/**
+ * reads exactly size bytes from a socket, retrying after interruptions and short reads
+ *
+ * @return false if the connection was closed or failed first
+ */
+bool read_fully(int fd, void* data, size_t size)
+{
+    char* bytes = (char*) data;
+    while (size > 0)
+    {
+        ssize_t num_read = read(fd, bytes, size);
+        if (num_read < 0 && errno == EINTR)
+            continue;
+        if (num_read <= 0)
+            return false;
+
+        bytes += num_read;
+        size -= (size_t) num_read;
+    }
+    return true;
+}
+
+/**
+ * writes exactly size bytes to a socket, retrying after interruptions and short writes
+ *
+ * @return false if the connection was closed or failed first
+ */
+bool write_fully(int fd, const void* data, size_t size)
+{
+    const char* bytes = (const char*) data;
+    while (size > 0)
+    {
+        ssize_t num_written = write(fd, bytes, size);
+        if (num_written < 0 && errno == EINTR)
+            continue;
+        if (num_written <= 0)
+            return false;
+
+        bytes += num_written;
+        size -= (size_t) num_written;
+    }
+    return true;
+}
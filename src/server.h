@@ -0,0 +1,26 @@
+#ifndef CLASSIFIER_SERVER_H
+#define CLASSIFIER_SERVER_H
+
+#include <string>
+#include "util.h"
+
+// maximum number of requests a worker classifies with a single model snapshot
+#define SERVER_BATCH_SIZE 32
+
+// maximum number of requests waiting for a worker
+#define SERVER_QUEUE_CAPACITY 1024
+
+// maximum size of a single email sent to the server
+#define SERVER_MAX_REQUEST_BYTES (16 << 20)
+
+// first and longest wait before accepting connections again, once out of descriptors or memory
+#define SERVER_ACCEPT_MIN_BACKOFF_MS 10
+#define SERVER_ACCEPT_MAX_BACKOFF_MS 1000
+
+// set in the length of a request that reports an email as spam or ham rather than classifying it
+#define SERVER_REPORT_FLAG 0x80000000u
+
+/**** function prototypes ****/
+int serve_classifications(const FilePath&, const std::string&, double, size_t);
+
+#endif //CLASSIFIER_SERVER_H
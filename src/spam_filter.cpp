@@ -0,0 +1,55 @@
+#include <new>
+#include "spam_filter.h"
+#include "filter.h"
+
+struct bsf_model
+{
+    Model model;
+};
+
+/**** functions ****/
+bsf_model* bsf_model_load(const char* model_path)
+{
+    if (model_path == nullptr)
+        return nullptr;
+
+    bsf_model* model = new (std::nothrow) bsf_model;
+    if (model == nullptr)
+        return nullptr;
+
+    try
+    {
+        model->model = load_model(model_path);
+        return model;
+    }
+    catch (const std::exception&)
+    {
+        delete model;
+        return nullptr;
+    }
+}
+
+void bsf_model_free(bsf_model* model)
+{
+    delete model;
+}
+
+int bsf_classify(const bsf_model* model, const char* data, size_t size, double zeta, bsf_result* result)
+{
+    if (model == nullptr || result == nullptr || (data == nullptr && size > 0))
+        return -1;
+
+    try
+    {
+        Classification classify_result = classify_new_email_buffer(data, size, model->model, zeta);
+
+        result->is_spam = (classify_result.first == EmailClass::SPAM);
+        result->log_prob_spam = (double) classify_result.second[0];
+        result->log_prob_ham = (double) classify_result.second[1];
+        return 0;
+    }
+    catch (const std::exception&)
+    {
+        return -1;
+    }
+}
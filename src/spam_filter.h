@@ -0,0 +1,51 @@
+#ifndef CLASSIFIER_SPAM_FILTER_H
+#define CLASSIFIER_SPAM_FILTER_H
+
+/*
+ * C interface of the spamfilter library, for embedding the classifier in other programs.
+ * a model, written by `classifier train`, is loaded once and then used to classify emails
+ * held in memory; the filesystem is only touched when loading the model.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BSF_API_VERSION 1
+
+typedef struct bsf_model bsf_model;
+
+typedef struct bsf_result
+{
+    int is_spam;                // 1 if the email was classified as SPAM, 0 if HAM
+    double log_prob_spam;       // ln P(SPAM|Email)
+    double log_prob_ham;        // ln P(HAM|Email)
+} bsf_result;
+
+/**
+ * loads a model file; any number of models may be loaded and used at the same time
+ *
+ * @return the model, or NULL if the file could not be read
+ */
+bsf_model* bsf_model_load(const char* model_path);
+
+/**
+ * releases a model returned by bsf_model_load(); NULL is ignored
+ */
+void bsf_model_free(bsf_model* model);
+
+/**
+ * classifies the email held in data[0, size) with decision factor zeta and the priors of the model
+ *
+ * @return 0 on success, -1 if model or result is NULL, or if the email could not be classified
+ *  (for lack of memory, say); result is then left unchanged
+ */
+int bsf_classify(const bsf_model* model, const char* data, size_t size, double zeta, bsf_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CLASSIFIER_SPAM_FILTER_H
@@ -0,0 +1,221 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "trace.h"
+
+/**** type definitions ****/
+
+// a finished span
+struct TraceEvent
+{
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+    uint32_t thread_id;
+};
+
+// ring buffer of the spans of one thread at a time. only its thread writes it: the span goes in
+// the slot after the last one, and then the count of spans is published, without locks or atomic
+// read-modify-writes. buffers of exited threads are handed to new threads, which is why every
+// span keeps the id of its thread
+struct TraceBuffer
+{
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(TRACE_BUFFER_SPANS);
+    std::atomic<uint64_t> num_events{0};                    // spans ever written, including overwritten ones
+};
+
+// hands the buffer of a thread back when the thread exits
+struct TraceBufferLease
+{
+    TraceBuffer* buffer = nullptr;
+    uint32_t thread_id = 0;
+
+    ~TraceBufferLease();
+};
+
+/**** global variables ****/
+std::atomic<bool> tracing_enabled{false};
+
+// every buffer ever used, and those no running thread holds
+static std::mutex trace_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> trace_buffers;
+static std::vector<TraceBuffer*> free_trace_buffers;
+static uint32_t num_traced_threads = 0;
+
+// time spans are measured from
+static const std::chrono::steady_clock::time_point trace_start = std::chrono::steady_clock::now();
+
+// file named by TRACE_FILE_ENV
+static FilePath trace_file;
+
+/**** function prototypes ****/
+TraceBufferLease& get_thread_trace_buffer();
+void save_trace_at_exit();
+
+/**** functions ****/
+
+TraceSpan::TraceSpan(const char* name) : name(name), begin_ns(0)
+{
+    if (tracing_enabled.load(std::memory_order_relaxed))
+        begin_ns = get_trace_time() + 1;
+}
+
+TraceSpan::~TraceSpan()
+{
+    // begin_ns is offset by one, so that 0 means the span started while tracing was off
+    if (begin_ns != 0)
+        record_span(name, begin_ns - 1, get_trace_time());
+}
+
+TraceBufferLease::~TraceBufferLease()
+{
+    if (buffer == nullptr)
+        return;
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    free_trace_buffers.push_back(buffer);
+}
+
+/**
+ * gets the buffer of the calling thread, taking one the first time the thread records a span
+ */
+TraceBufferLease& get_thread_trace_buffer()
+{
+    thread_local TraceBufferLease lease;
+    if (lease.buffer == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        if (free_trace_buffers.empty())
+        {
+            trace_buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer()));
+            free_trace_buffers.push_back(trace_buffers.back().get());
+        }
+        lease.buffer = free_trace_buffers.back();
+        free_trace_buffers.pop_back();
+        lease.thread_id = ++num_traced_threads;
+    }
+    return lease;
+}
+
+/**
+ * gets the time since the program started
+ *
+ * @return the time in nanoseconds
+ */
+uint64_t get_trace_time()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_start).count();
+}
+
+/**
+ * records a finished span of the calling thread; use TraceSpan, which first checks whether tracing is on
+ *
+ * @param name : name of the span
+ * @param begin_ns : when it began, from get_trace_time()
+ * @param end_ns : when it ended, from get_trace_time()
+ */
+void record_span(const char* name, uint64_t begin_ns, uint64_t end_ns)
+{
+    TraceBufferLease& lease = get_thread_trace_buffer();
+    uint64_t num_events = lease.buffer->num_events.load(std::memory_order_relaxed);
+    lease.buffer->events[num_events % TRACE_BUFFER_SPANS] = {name, begin_ns, end_ns, lease.thread_id};
+    lease.buffer->num_events.store(num_events + 1, std::memory_order_release);
+}
+
+/**
+ * starts or stops recording spans; spans recorded so far are kept
+ *
+ * @param enabled : whether spans are recorded from now on
+ */
+void set_tracing_enabled(bool enabled)
+{
+    tracing_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * starts recording spans if TRACE_FILE_ENV names a file, and then writes the trace there when the
+ * program exits
+ *
+ * @return whether spans are recorded
+ */
+bool enable_tracing_from_environment()
+{
+    const char* path = std::getenv(TRACE_FILE_ENV);
+    if (path == nullptr || *path == '\0')
+        return false;
+
+    bool first_time = trace_file.empty();
+    trace_file = path;
+    set_tracing_enabled(true);
+    if (first_time)
+        std::atexit(save_trace_at_exit);
+    return true;
+}
+
+/**
+ * writes the recorded spans in the Chrome trace event format, as complete ("X") events in
+ * microseconds. the spans of a buffer being written at the same time may be torn, so the trace is
+ * meant to be written once the traced work is over
+ *
+ * @return the JSON text
+ */
+std::string trace_to_json()
+{
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    std::ostringstream json;
+    json << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+
+    bool first = true;
+    for (uint32_t thread_id = 1; thread_id <= num_traced_threads; ++thread_id)
+    {
+        json << (first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+             << thread_id << ", \"args\": {\"name\": \"thread " << thread_id << "\"}}";
+        first = false;
+    }
+
+    json.setf(std::ios::fixed);
+    json.precision(3);
+    for (const auto& buffer : trace_buffers)
+    {
+        uint64_t num_events = buffer->num_events.load(std::memory_order_acquire);
+        uint64_t first_event = (num_events > TRACE_BUFFER_SPANS) ? num_events - TRACE_BUFFER_SPANS : 0;
+        for (uint64_t i = first_event; i < num_events; ++i)
+        {
+            const TraceEvent& event = buffer->events[i % TRACE_BUFFER_SPANS];
+            json << (first ? "" : ",") << "\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                 << event.thread_id << ", \"ts\": " << (double) event.begin_ns / 1e3
+                 << ", \"dur\": " << (double) (event.end_ns - event.begin_ns) / 1e3 << "}";
+            first = false;
+        }
+    }
+    json << "\n]}\n";
+    return json.str();
+}
+
+/**
+ * writes the trace to the file named by TRACE_FILE_ENV
+ *
+ * @return whether the trace was written
+ */
+bool save_trace()
+{
+    if (trace_file.empty())
+        return false;
+
+    std::ofstream file(trace_file);
+    file << trace_to_json();
+    return (bool) file;
+}
+
+/**
+ * writes the trace when the program exits
+ */
+void save_trace_at_exit()
+{
+    save_trace();
+}
@@ -0,0 +1,46 @@
+#ifndef CLASSIFIER_TRACE_H
+#define CLASSIFIER_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "util.h"
+
+// environment variable naming the file a Chrome trace (chrome://tracing, ui.perfetto.dev) of the
+// run is written to when the program exits; spans are only recorded when set
+#define TRACE_FILE_ENV "SPAMFILTER_TRACE"
+
+// number of spans every thread keeps; once its ring buffer is full, a thread overwrites its oldest spans
+#define TRACE_BUFFER_SPANS (1 << 16)
+
+/**** type definitions ****/
+
+// whether spans are recorded; when they are not, a span costs one relaxed load and a branch
+extern std::atomic<bool> tracing_enabled;
+
+/**
+ * records a span of the calling thread, from its construction to its destruction, if tracing is on.
+ * the name must outlive the trace, which string literals do
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    uint64_t begin_ns;
+};
+
+/**** function prototypes ****/
+uint64_t get_trace_time();
+void record_span(const char*, uint64_t, uint64_t);
+void set_tracing_enabled(bool);
+bool enable_tracing_from_environment();
+std::string trace_to_json();
+bool save_trace();
+
+#endif //CLASSIFIER_TRACE_H
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include "dir_scan.h"
+#include "metrics.h"
+#include "trace.h"
+#include "util.h"
+
+/**** functions ****/
+FileList get_files_in_folder(const DirPath& dir_path, const std::string& extension)
+{
+    PhaseTimer timer(SCAN_PHASE);
+    TraceSpan span("get_files_in_folder");
+    FileList file_list;
+    DirectoryScanner scanner(dir_path, extension);
+
+    FilePath file_path;
+    while (scanner.next(file_path))
+        file_list.push_back(file_path);
+
+    if (scanner.get_num_errors() > 0)
+        throw std::runtime_error("cannot read directory " + dir_path);
+
+    return file_list;
+}
+
+WordList get_words_in_file(const FilePath& file_path)
+{
+    PhaseTimer timer(TOKENIZE_PHASE);
+    TraceSpan span("tokenize");
+    WordList word_list;
+    std::ifstream file(file_path, std::ios::ate);
+    std::streamoff file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::string word;
+    while (file >> word)
+        word_list.push_back(word);
+
+    count_metric(BYTES_READ, file_size > 0 ? (uint64_t) file_size : 0);
+    count_metric(TEXTS_TOKENIZED);
+    count_metric(TOKENS_SCANNED, word_list.size());
+    return word_list;
+}
+
+bool read_file(const FilePath& file_path, std::string& contents)
+{
+    PhaseTimer timer(READ_PHASE);
+    TraceSpan span("read");
+
+    // directories open fine as streams, but report a meaningless size
+    boost::system::error_code error;
+    if (!fs::is_regular_file(file_path, error))
+        return false;
+
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    std::streamoff size = file.tellg();
+    contents.resize(size > 0 ? (size_t) size : 0);
+    file.seekg(0, std::ios::beg);
+    file.read(&contents[0], (std::streamsize) contents.size());
+    contents.resize((size_t) file.gcount());
+    count_metric(BYTES_READ, contents.size());
+
+    return !file.bad();
+}
+
+bool read_file_prefix(const FilePath& file_path, std::string& contents, size_t max_bytes, bool& truncated)
+{
+    PhaseTimer timer(READ_PHASE);
+    TraceSpan span("read");
+    contents.clear();
+    truncated = false;
+
+    boost::system::error_code error;
+    if (!fs::is_regular_file(file_path, error))
+        return false;
+
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    std::streamoff size = file.tellg();
+    contents.resize(size > 0 ? std::min((size_t) size, max_bytes) : 0);
+    file.seekg(0, std::ios::beg);
+    file.read(&contents[0], (std::streamsize) contents.size());
+    contents.resize((size_t) file.gcount());
+    count_metric(BYTES_READ, contents.size());
+
+    // a word cut at max_bytes is only complete if it is followed by a whitespace
+    if (size > 0 && (size_t) size > contents.size())
+    {
+        truncated = true;
+        if (!std::isspace(file.peek()))
+            while (!contents.empty() && !std::isspace((unsigned char) contents.back()))
+                contents.pop_back();
+    }
+
+    return !file.bad();
+}
+
+FreqDict get_word_freq_in_files(const FileList& files)
+{
+    FreqDict freq_dict;
+
+    for (const FilePath& file : files)
+    {
+        WordList words = get_words_in_file(file);
+        TraceSpan span("count");
+        for (const std::string& word : words)
+            if (!word.empty())
+                ++freq_dict[word];
+    }
+
+    return freq_dict;
+}
+
+FreqDict get_word_freq_in_file(const FilePath& file_path)
+{
+    FreqDict freq_dict;
+
+    WordList words = get_words_in_file(file_path);
+    for (const std::string& word : words)
+        if (!word.empty())
+            ++freq_dict[word];
+
+    count_metric(DISTINCT_TOKENS, freq_dict.size());
+    return freq_dict;
+}
+
+FreqDict get_word_freq_in_buffer(const char* data, size_t size)
+{
+    PhaseTimer timer(TOKENIZE_PHASE);
+    TraceSpan span("tokenize");
+    FreqDict freq_dict;
+    size_t num_tokens = 0;
+
+    // words are separated by whitespace, as when reading them from a file stream
+    std::string word;
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (!std::isspace((unsigned char) data[i]))
+            word.push_back(data[i]);
+        else if (!word.empty())
+        {
+            ++freq_dict[word];
+            ++num_tokens;
+            word.clear();
+        }
+    }
+    if (!word.empty())
+    {
+        ++freq_dict[word];
+        ++num_tokens;
+    }
+
+    count_metric(TEXTS_TOKENIZED);
+    count_metric(TOKENS_SCANNED, num_tokens);
+    count_metric(DISTINCT_TOKENS, freq_dict.size());
+    return freq_dict;
+}
+
+FreqDict get_word_freq_in_buffer_range(const char* data, size_t size, size_t begin, size_t end)
+{
+    // a range counts the words starting in it: a word cut by its beginning belongs to the previous
+    // range, and a word cut by its end is counted to its end
+    end = std::min(end, size);
+    if (begin > 0)
+        while (begin < end && !std::isspace((unsigned char) data[begin - 1]))
+            ++begin;
+    if (begin >= end)
+        return FreqDict();
+
+    while (end < size && !std::isspace((unsigned char) data[end - 1]))
+        ++end;
+
+    return get_word_freq_in_buffer(data + begin, end - begin);
+}
+
+EmailClass get_email_label(const FilePath& email_path)
+{
+    std::string file_name = fs::path(email_path).filename().string();
+
+    if (file_name.find("spam") != std::string::npos)
+       return EmailClass::SPAM;
+    return EmailClass::HAM;
+}
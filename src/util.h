@@ -7,10 +7,10 @@
 #include <unordered_map>
 #include <eigen3/Eigen/Eigen>
 #include <boost/filesystem.hpp>
-#include "matplotlib.h"
 
 /**** type definitions ****/
 enum EmailClass {SPAM = 0, HAM = 1};
+enum ScoringMode {FULL_SCAN = 0, SIGNIFICANT_WORDS = 1, EARLY_EXIT = 2, STREAMING = 3};
 typedef long double Prob;                                   // probability
 typedef std::string DirPath;                                // folder path
 typedef std::string FilePath;                               // file path
@@ -20,92 +20,50 @@ typedef std::unordered_map<std::string, Prob> ProbDict;     // dictionary of pro
 typedef std::unordered_map<std::string, size_t> FreqDict;   // dictionary of frequencies
 typedef std::array<FileList, 2> FileListPair;               // two-element array of file lists
 typedef std::array<ProbDict, 2> ProbDictPair;               // two-element array of probability dictionaries
+typedef std::array<FreqDict, 2> FreqDictPair;               // two-element array of frequency dictionaries
+typedef std::array<size_t, 2> CountPair;                    // two-element array of numbers of spam and ham emails
 typedef std::array<Prob, 2> ProbPair;                       // two-element array of probabilities
+typedef std::array<ProbPair, 2> LogProbBounds;              // two-element array of [min, max] of ln P(w_i|Class)
 typedef std::array<double, 2> ErrorPair;                    // two-element array of type 1 and 2 errors
 typedef std::pair<EmailClass, ProbPair> Classification;     // a pair of email class and two-element array of probabilities
 typedef Eigen::Matrix2i PerformanceMatrix;                  // 2x2 matrix containing number of emails classified as:
                                                             // [ #(SPAM|SPAM)   ;   #(HAM|SPAM)
                                                             //   #(SPAM|HAM)    ;   #(HAM|HAM) ]
 
-namespace plt = matplotlibcpp;
-namespace fs = boost::filesystem;
+// running terms of [ln P(Class and Email)] for both classes while an email is read word by word
+struct PartialScores
+{
+    FreqDict word_freq;                                     // f_(w_i) of the words read so far
+    ProbPair log_prob_words = {0.0, 0.0};                   // \sum f_(w_i)*[ln P(w_i|Class)]
+    std::array<long double, 2> num = {0.0, 0.0};            // numerator of the multinomial term
+    std::array<long double, 2> den = {1.0, 1.0};            // ln of denominator of the multinomial term
+};
+
+// word frequencies and numbers of emails of a training set, or of emails added to one
+struct TrainingCounts
+{
+    FreqDictPair freq_by_category;                          // f_i of every word in the spam and ham emails
+    CountPair num_emails_by_category = {0, 0};              // number of spam and ham emails
+};
 
-extern size_t num_spam_emails;
-extern size_t num_ham_emails;
+// naive Bayes model; everything needed to classify emails is carried by the model itself, and
+// P(w_i|Class) is derived from its counts when it is needed
+struct Model : TrainingCounts
+{
+    ProbPair prior_by_category = {0.5, 0.5};                // prior probabilities of SPAM and HAM
+};
+
+namespace fs = boost::filesystem;
 
 /**** function prototypes ****/
 FileList get_files_in_folder(const DirPath&, const std::string& extension = ".txt");
 WordList get_words_in_file(const FilePath&);
+bool read_file(const FilePath&, std::string&);
+bool read_file_prefix(const FilePath&, std::string&, size_t, bool&);
 FreqDict get_word_freq_in_files(const FileList&);
 FreqDict get_word_freq_in_file(const FilePath&);
+FreqDict get_word_freq_in_buffer(const char*, size_t);
+FreqDict get_word_freq_in_buffer_range(const char*, size_t, size_t, size_t);
 EmailClass get_email_label(const FilePath&);
 
-/**** functions ****/
-FileList get_files_in_folder(const DirPath& dir_path, const std::string& extension)
-{
-    FileList file_list;
-    fs::path path = fs::system_complete(dir_path);
-
-    if (!path.empty())
-    {
-        fs::directory_iterator end;
-
-        for (auto i = fs::directory_iterator(path); i != end; ++i)
-        {
-            if (fs::extension(i->path()) == extension)
-                file_list.push_back(i->path().string());
-        }
-    }
-
-    return file_list;
-}
-
-WordList get_words_in_file(const FilePath& file_path)
-{
-    WordList word_list;
-    std::ifstream file(file_path);
-
-    std::string word;
-    while (file >> word)
-        word_list.push_back(word);
-
-    return word_list;
-}
-
-FreqDict get_word_freq_in_files(const FileList& files)
-{
-    FreqDict freq_dict;
-
-    for (const FilePath& file : files)
-    {
-        WordList words = get_words_in_file(file);
-        for (const std::string& word : words)
-            if (!word.empty())
-                ++freq_dict[word];
-    }
-
-    return freq_dict;
-}
-
-FreqDict get_word_freq_in_file(const FilePath& file_path)
-{
-    FreqDict freq_dict;
-
-    WordList words = get_words_in_file(file_path);
-    for (const std::string& word : words)
-        if (!word.empty())
-            ++freq_dict[word];
-
-    return freq_dict;
-}
-
-EmailClass get_email_label(const FilePath& email_path)
-{
-    std::string file_name = fs::path(email_path).filename().string();
-
-    if (file_name.find("spam") != std::string::npos)
-       return EmailClass::SPAM;
-    return EmailClass::HAM;
-}
-
 #endif //CLASSIFIER_UTIL_H